@@ -1,213 +1,371 @@
 #include <stdlib.h>
 #include "mpi.h"
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include "capar.h"
+#include "halo.h"
+#include "packed.h"
 #include "random.h"
 #include "md5tool.h"
 
-// Tag for MPI communication
-#define TAG 2021
-
-/* horizontal size of the configuration */
-#define XSIZE 1024
-
-/* "ADT" State and line of states (plus border) */
-typedef char State;
-typedef State Line[XSIZE + 2];
-
 /* determine random integer between 0 and n-1 */
 #define randInt(n) ((int)(nextRandomLEcuyer() * n))
 
-/* random starting configuration */
-static void initConfig(Line *buf, int lines) {  
+/* cell x of line y of a block with s cells per line */
+#define cell(a, s, x, y) (a)[(size_t) (y) * (s) + (x)]
+
+/* random starting configuration of lines lines and width cells */
+static void initConfig(State *buf, int lines, int width) {  
    int x, y;
 
    initRandomLEcuyer(424243);
    for (y = 1;  y <= lines;  y++) {
-      for (x = 1;  x <= XSIZE;  x++) {
-         buf[y][x] = randInt(100) >= 50;
+      for (x = 1;  x <= width;  x++) {
+         cell(buf, width + 2, x, y) = randInt(100) >= 50;
       }
    }
 }
 
-static void boundary(Line *buf, int lines, int top, int bot) {  
+/* random starting configuration of the block of this process, the same
+ * as initConfig. The processes of a process row draw the numbers of all
+ * cells of their lines and keep their own ones; the generator state then
+ * goes down to the next process row. The shuffle table of the generator
+ * depends on every number drawn before, so there is no exact jump to the
+ * first line of a block, but no process needs more than its block. */
+static void initBlock(const Grid *g, State *buf) {
+   StateLEcuyer rng;
+   int x, y, s = g->cols + 2;
+
+   if (g->coords[0] == 0) {
+      initRandomLEcuyer(424243);
+   } else {
+      MPI_Recv(&rng, sizeof(rng), MPI_BYTE, g->nb[0][1], TAG, g->comm, MPI_STATUS_IGNORE);
+      setStateLEcuyer(&rng);
+   }
+   for (y = 1;  y <= g->lines;  y++) {
+      for (x = 1;  x <= g->x0;  x++) {
+         nextRandomLEcuyer();
+      }
+      for (x = 1;  x <= g->cols;  x++) {
+         cell(buf, s, x, y) = randInt(100) >= 50;
+      }
+      for (x = g->x0 + g->cols + 1;  x <= g->width;  x++) {
+         nextRandomLEcuyer();
+      }
+   }
+   if (g->coords[0] < g->dims[0] - 1) {
+      getStateLEcuyer(&rng);
+      MPI_Send(&rng, sizeof(rng), MPI_BYTE, g->nb[2][1], TAG, g->comm);
+   }
+}
 
-   for (int y = 0;  y <= lines+1;  y++) {
-      /* copy rightmost column to the buffer column 0 */
-      buf[y][0      ] = buf[y][XSIZE];
+/* configuration of lines lines and width cells (plus border) on process 0 */
+static State *allocFinal(int lines, int width) {
+   State *final;
 
-      /* copy leftmost column to the buffer column XSIZE + 1 */
-      buf[y][XSIZE+1] = buf[y][1    ];
+   // Try to allocate memory for the grid
+   final = calloc((size_t) (lines + 2) * (width + 2), sizeof(State));
+   if (final == NULL) {
+      perror("Could not allocate memory for final.");
+      MPI_Abort(MPI_COMM_WORLD, MPI_ERR_UNKNOWN);
+      MPI_Finalize();
    }
+   return final;
+}
 
-   MPI_Status status;
-   // Send bottommost line and receive the one sent to this process
-   MPI_Send(&buf[lines], sizeof(Line), MPI_CHAR, bot, TAG, MPI_COMM_WORLD);
-   MPI_Recv(&buf[0], sizeof(Line), MPI_CHAR, top, TAG, MPI_COMM_WORLD, &status);
+/* lines lines of cells first..last of a block with s cells per line,
+ * starting at cell first of the first line */
+static MPI_Datatype blockType(int lines, int first, int last, int s) {
+   MPI_Datatype type;
 
-   // Send topmost line and receive the one sent to this process
-   MPI_Send(&buf[1], sizeof(Line), MPI_CHAR, top, TAG, MPI_COMM_WORLD);
-   MPI_Recv(&buf[lines + 1], sizeof(Line), MPI_CHAR, bot, TAG, MPI_COMM_WORLD, &status);
+   MPI_Type_vector(lines, last - first + 1, s, MPI_CHAR, &type);
+   MPI_Type_commit(&type);
+   return type;
 }
 
-/* annealing rule from ChoDro96 page 34 
- * the table is used to map the number of nonzero
- * states in the neighborhood to the new state
- */
-static State anneal[10] = {0, 0, 0, 0, 1, 0, 1, 1, 1, 1};
+/* cells of a block sent to process 0 at the end: the own ones, plus the
+ * border if it is the border of the configuration */
+static void resultColumns(const Grid *g, const int coords[2], int cols, int *first, int *last) {
+   *first = (coords[1] == 0) ? 0 : 1;
+   *last = (coords[1] == g->dims[1] - 1) ? cols + 1 : cols;
+}
 
-/* a: pointer to array; x,y: coordinates; result: n-th element of anneal,
-      where n is the number of neighbors */
-#define transition(a, x, y) \
-   (anneal[(a)[(y)-1][(x)-1] + (a)[(y)][(x)-1] + (a)[(y)+1][(x)-1] +\
-           (a)[(y)-1][(x)  ] + (a)[(y)][(x)  ] + (a)[(y)+1][(x)  ] +\
-           (a)[(y)-1][(x)+1] + (a)[(y)][(x)+1] + (a)[(y)+1][(x)+1]])
+/* a: pointer to the block with s cells per line; x,y: coordinates;
+      result: n-th element of anneal, where n is the number of neighbors */
+#define transition(a, s, x, y) \
+   (anneal[cell(a, s, (x)-1, (y)-1) + cell(a, s, (x)-1, (y)) + cell(a, s, (x)-1, (y)+1) +\
+           cell(a, s, (x)  , (y)-1) + cell(a, s, (x)  , (y)) + cell(a, s, (x)  , (y)+1) +\
+           cell(a, s, (x)+1, (y)-1) + cell(a, s, (x)+1, (y)) + cell(a, s, (x)+1, (y)+1)])
 
-/* make one simulation iteration with lines lines.
+/* make one simulation iteration on the cells first..last of the lines
+ * top..bot of a block with s cells per line.
  * old configuration is in from, new one is written to to.
  */
-static void simulate(Line *from, Line *to, int lines)
+static void simulate(const State *restrict from, State *restrict to, int s, int top, int bot, int first, int last)
 {
    int x,y;
 
-   for (y = 1;  y <= lines;  y++) {
-      for (x = 1;  x <= XSIZE;  x++) {
-         to[y][x  ] = transition(from, x  , y);
+   for (y = top;  y <= bot;  y++) {
+      // Line y - 1 of from, the lines y and y + 1 follow s cells apart
+      const State *above = &cell(from, s, 0, y - 1);
+      State *line = &cell(to, s, 0, y);
+
+      for (x = first;  x <= last;  x++) {
+         line[x] = transition(above, s, x, 1);
       }
    }
 }
 
+/* simulate the border of a block of lines times cols cells, the cells
+ * that need the halo: all but the cells inFirst..inLast of lines 2..lines - 1 */
+static void simulateBorder(const State *from, State *to, int lines, int cols, int inFirst, int inLast)
+{
+   int s = cols + 2, right = (inLast >= inFirst) ? inLast + 1 : inFirst;
+
+   simulate(from, to, s, 1, 1, 1, cols);
+   if (lines > 1) {
+      simulate(from, to, s, lines, lines, 1, cols);
+   }
+   simulate(from, to, s, 2, lines - 1, 1, inFirst - 1);
+   simulate(from, to, s, 2, lines - 1, right, cols);
+}
+
 int main(int argc, char **argv) {
 
-   if (argc != 3) {
-      fprintf(stderr, "Usage: %s <height of grid> <iterations>\n", argv[0]);
+   bool packed = true;           // Engine, see packed.h
+   bool overlap = true;          // Halo exchange, see halo.h
+   int depth = 0;                // Halo depth of the packed engine, 0: auto-tuned
+   int width = XSIZE;            // Cells per line
+   int dims[2] = { 0, 0 };       // Shape of the process grid, 0: picked by gridCreate
+   bool serialInit = false;      // Starting configuration from process 0, see initBlock
+   int nprocs, rank;             // Process relevant values
+   int opt;
+
+   // Every process parses the options, only process 0 complains about them
+   MPI_Init(&argc, &argv);
+   MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+   while ((opt = getopt(argc, argv, "e:x:k:w:g:i:")) != -1) {
+      switch (opt) {
+      case 'e':
+         if (strcmp(optarg, "byte") == 0) {
+            packed = false;
+         } else if (strcmp(optarg, "packed") != 0) {
+            argc = 0;   // Print the usage
+         }
+         break;
+      case 'x':
+         if (strcmp(optarg, "blocking") == 0) {
+            overlap = false;
+         } else if (strcmp(optarg, "overlap") != 0) {
+            argc = 0;
+         }
+         break;
+      case 'k':
+         if (strcmp(optarg, "auto") != 0 && (depth = (int) strtol(optarg, NULL, 0)) < 1) {
+            argc = 0;
+         }
+         break;
+      case 'w':
+         if ((width = (int) strtol(optarg, NULL, 0)) < 1) {
+            argc = 0;
+         }
+         break;
+      case 'g':
+         if (sscanf(optarg, "%dx%d", &dims[0], &dims[1]) != 2 || dims[0] < 1 || dims[1] < 1) {
+            argc = 0;
+         }
+         break;
+      case 'i':
+         if (strcmp(optarg, "serial") == 0) {
+            serialInit = true;
+         } else if (strcmp(optarg, "distributed") != 0) {
+            argc = 0;
+         }
+         break;
+      default:
+         argc = 0;
+      }
+   }
+
+   if (argc - optind != 2 || (!packed && depth > 1)) {
+      if (rank) {
+         MPI_Finalize();
+         exit(EXIT_FAILURE);
+      }
+      fprintf(stderr, "Usage: %s [-e packed|byte] [-x overlap|blocking] [-k <depth>|auto] [-w <width>] [-g <rows>x<columns>] [-i distributed|serial] <height of grid> <iterations>\n", argv[0]);
+      fprintf(stderr, "  -e  engine: 64 cells per word (default, the width has to be a multiple\n");
+      fprintf(stderr, "      of 64) or one byte per cell\n");
+      fprintf(stderr, "  -x  halo exchange: non-blocking while the inner cells are calculated\n");
+      fprintf(stderr, "      (default) or blocking before each iteration\n");
+      fprintf(stderr, "  -k  exchange depth ghost lines every depth iterations (packed engine,\n");
+      fprintf(stderr, "      default: picked from measured latency and bandwidth)\n");
+      fprintf(stderr, "  -w  cells per line (default: %d)\n", XSIZE);
+      fprintf(stderr, "  -g  processes along the lines and along a line (default: the shape\n");
+      fprintf(stderr, "      with the smallest halo)\n");
+      fprintf(stderr, "  -i  starting configuration: drawn by every process for its block\n");
+      fprintf(stderr, "      (default) or by process 0 and sent to the others\n");
+      MPI_Finalize();
       exit(EXIT_FAILURE);
    }
+   argv += optind - 1;
 
    double start, elapsed, time;  // Used for time measurment
+   double exposed = 0, maxExposed; // Time spent waiting for the halo
    int numberOfLines, its;       // Lines in grid and iterations
-   int nprocs, rank, procLines;  // Process relevant values 
-   int topRecip, botRecip;       // Neighbors of process i
-   Line *current, *next, *temp;  // Sub-grids of process i
+   Grid grid;                    // Block of process i and its neighbours
+   State *current, *next, *temp; // Sub-grids of process i
 
 
    numberOfLines = (int) strtol(argv[1], NULL, 0);
    its = (int) strtol(argv[2], NULL, 0);
 
-   MPI_Init(&argc, &argv);
-   MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
-   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-
    start = MPI_Wtime();
 
-   // Lines per process
-   if (rank != (nprocs - 1)) {
-      procLines = (numberOfLines / nprocs);
-   } else {
-      procLines = (numberOfLines / nprocs) + (numberOfLines % nprocs);
+   if (packed && width % 64 != 0) {
+      if (!rank) {
+         fprintf(stderr, "The packed engine needs a width that is a multiple of 64 (or use -e byte)\n");
+      }
+      MPI_Finalize();
+      exit(EXIT_FAILURE);
    }
-
-   botRecip = (rank + 1) % nprocs;  // Neighbor that receives bottommost line
-   if (!rank) {
-      topRecip = nprocs - 1; // Recipient of topmost line of process 0
-   } else {
-      topRecip = rank - 1; // Recipient of topmost
+   if (!gridCreate(&grid, numberOfLines, width, packed ? 64 : 1, dims)) {
+      if (!rank) {
+         fprintf(stderr, "Can't arrange %d processes on %d lines of %d cells%s\n", nprocs,
+                 numberOfLines, width, packed ? " (64 per process)" : "");
+      }
+      MPI_Finalize();
+      exit(EXIT_FAILURE);
+   }
+   int procLines = grid.lines, procCols = grid.cols, s = procCols + 2;
+
+   // Ghost lines only come from the direct neighbours
+   int fewest = numberOfLines / grid.dims[0];
+   int maxDepth = depth;
+   if (depth == 0) {
+      maxDepth = (fewest < MAX_DEPTH) ? fewest : MAX_DEPTH;
+   } else if (depth > fewest || depth > MAX_DEPTH) {
+      if (!rank) {
+         fprintf(stderr, "The halo depth can be at most the %d lines per process and %d\n", fewest, MAX_DEPTH);
+      }
+      MPI_Finalize();
+      exit(EXIT_FAILURE);
    }
 
    // Try to allocate memory
-   current = malloc((procLines + 2) * sizeof(Line));
-   next = malloc((procLines + 2) * sizeof(Line));
+   current = calloc((size_t) (procLines + 2) * s, sizeof(State));
+   next = packed ? NULL : calloc((size_t) (procLines + 2) * s, sizeof(State));
 
-   if (current == NULL || next == NULL) {
+   if (current == NULL || (next == NULL && !packed)) {
       perror("Could not allocate memory in process.\n");
       MPI_Abort(MPI_COMM_WORLD, MPI_ERR_UNKNOWN);
       MPI_Finalize();
    }
 
-   Line *final;
-   if (!rank) {
-
-      // Try to allocate memory for the grid
-      final = malloc((numberOfLines + 2) * sizeof(Line));
-      if (final == NULL) {
-         perror("Could not allocate memory for final.");
-         MPI_Abort(MPI_COMM_WORLD, MPI_ERR_UNKNOWN);
-         MPI_Finalize();
-      }
-
-      // Initialize the Grid
-      initConfig(final, numberOfLines);
-
-      // Copy the first procLines into current of process 0
-      for (int i = 1; i <= procLines; i++) {
-         for (int j = 0; j < sizeof(Line); j++) {
-            current[i][j] = final[i][j];
-         }
-      }
-
-      // Send all the other chunks to the other processes
-      for (int i = 1; i < nprocs; i++) {
-         if (i != nprocs - 1) {
-            MPI_Send(&final[i * procLines + 1], procLines * sizeof(Line), MPI_CHAR, i, TAG, MPI_COMM_WORLD);
-         } else {
-            MPI_Send(&final[i * procLines + 1], (procLines + (numberOfLines % nprocs)) * sizeof(Line), MPI_CHAR, i, TAG, MPI_COMM_WORLD);
+   State *final;
+   MPI_Datatype own;
+   MPI_Request req;
+   int y0, lines, x0, cols, first, last, coords[2];
+
+   if (serialInit) {
+      // Process 0 sends every process its block, itself included
+      own = blockType(procLines, 1, procCols, s);
+      MPI_Irecv(&cell(current, s, 1, 1), 1, own, 0, TAG, grid.comm, &req);
+      MPI_Type_free(&own);
+      if (!rank) {
+
+         // Initialize the Grid
+         final = allocFinal(numberOfLines, width);
+         initConfig(final, numberOfLines, width);
+
+         for (int i = 0; i < nprocs; i++) {
+            gridBlock(&grid, i, &y0, &lines, &x0, &cols);
+            MPI_Datatype block = blockType(lines, 1, cols, width + 2);
+            MPI_Send(&cell(final, width + 2, x0 + 1, y0 + 1), 1, block, i, TAG, grid.comm);
+            MPI_Type_free(&block);
          }
+         free(final);
       }
+      MPI_Wait(&req, MPI_STATUS_IGNORE);
    } else {
-      MPI_Status status;
-      MPI_Recv(current[1], procLines * sizeof(Line), MPI_CHAR, 0, TAG, MPI_COMM_WORLD, &status);
+      initBlock(&grid, current);
    }
 
-   // Simulate an iteration
-   for (int i = 0; i < its; i++) {
-      boundary(current, procLines, topRecip, botRecip);
-      simulate(current, next, procLines);
+   // Cells that need no ghost cell, all if the ghost columns are copied at once
+   int inFirst = (grid.dims[1] == 1) ? 1 : 2, inLast = (grid.dims[1] == 1) ? procCols : procCols - 1;
 
-      temp = current;
-      current = next;
-      next = temp;
+   if (packed) {
+      depth = simulatePacked(&grid, current, its, overlap, depth, maxDepth, &exposed);
+   } else {
+      Halo halo;
+      haloCreate(&halo, &grid, s, MPI_CHAR, procLines, procCols, 1);
+
+      // Simulate an iteration
+      for (int i = 0; i < its; i++) {
+         MPI_Request req[HALO_REQUESTS];
+
+         haloStart(&halo, current, 1, req);
+         if (overlap) {
+            simulate(current, next, s, 2, procLines - 1, inFirst, inLast);
+            haloWait(req, &exposed);
+            simulateBorder(current, next, procLines, procCols, inFirst, inLast);
+         } else {
+            haloWait(req, &exposed);
+            simulate(current, next, s, 1, procLines, 1, procCols);
+         }
+
+         temp = current;
+         current = next;
+         next = temp;
+      }
+      haloFree(&halo);
    }
 
    // Alle Prozesse senden ihr finales Gitter an 0
+   resultColumns(&grid, grid.coords, procCols, &first, &last);
+   own = blockType(procLines, first, last, s);
+   MPI_Isend(&cell(current, s, first, 1), 1, own, 0, TAG, grid.comm, &req);
+   MPI_Type_free(&own);
    if (!rank) {
-      
-      // Copy process 0's data into final
-      for (int i = 1; i <= procLines; i++) {
-         for (int j = 0; j < sizeof(Line); j++) {
-            final[i][j] = current[i][j];
-         }
-      }
 
-      // Collect all the data from the other processes into final
-      MPI_Status status;
-      for (int i = 1; i < nprocs; i++) {
-         if (i != (nprocs - 1)) {
-            MPI_Recv(&final[(i * procLines) + 1], procLines * sizeof(Line), MPI_CHAR, i, TAG, MPI_COMM_WORLD, &status);
-         } else {
-            MPI_Recv(&final[(i * procLines) + 1], (procLines + (numberOfLines % nprocs)) * sizeof(Line), MPI_CHAR, i, TAG, MPI_COMM_WORLD, &status);
-         }
+      // Collect all the blocks into final
+      final = allocFinal(numberOfLines, width);
+      for (int i = 0; i < nprocs; i++) {
+         gridBlock(&grid, i, &y0, &lines, &x0, &cols);
+         MPI_Cart_coords(grid.comm, i, 2, coords);
+         resultColumns(&grid, coords, cols, &first, &last);
+         MPI_Datatype block = blockType(lines, first, last, width + 2);
+         MPI_Recv(&cell(final, width + 2, x0 + first, y0 + 1), 1, block, i, TAG, grid.comm, MPI_STATUS_IGNORE);
+         MPI_Type_free(&block);
       }
 
       // Calculate the hash
       char *hash;
-      hash = getMD5DigestStr(final[1], sizeof(Line) * numberOfLines);
+      hash = getMD5DigestStr(&cell(final, width + 2, 0, 1), (width + 2) * (size_t) numberOfLines);
       printf("hash: %s\n", hash);
 
       free(final);
       free(hash);
-   } else {
-      MPI_Send(&current[1], sizeof(Line) * procLines, MPI_CHAR, 0, TAG, MPI_COMM_WORLD);
    }
+   MPI_Wait(&req, MPI_STATUS_IGNORE);
 
    free(current);
    free(next);
 
    elapsed = MPI_Wtime() - start;
    MPI_Reduce(&elapsed, &time, 1, MPI_DOUBLE, MPI_MAX, 0 , MPI_COMM_WORLD);
+   MPI_Reduce(&exposed, &maxExposed, 1, MPI_DOUBLE, MPI_MAX, 0 , MPI_COMM_WORLD);
    if (!rank) {
         fprintf(stderr, "Time used: %14.8f seconds\n", time);
+        fprintf(stderr, "Halo wait: %14.8f seconds (slowest process)\n", maxExposed);
+        fprintf(stderr, "Halo depth: %d\n", packed ? depth : 1);
+        fprintf(stderr, "Process grid: %dx%d\n", grid.dims[0], grid.dims[1]);
    }
 
+   gridFree(&grid);
    MPI_Barrier(MPI_COMM_WORLD);
    MPI_Finalize();
 }
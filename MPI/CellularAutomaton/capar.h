@@ -0,0 +1,21 @@
+#ifndef CAPAR_H
+#define CAPAR_H
+
+/* Definitions shared by the engines of capar */
+
+// Tag for MPI communication
+#define TAG 2021
+
+/* default horizontal size of the configuration (capar -w) */
+#define XSIZE 1024
+
+/* "ADT" State; a line of width states has a border cell on each side */
+typedef char State;
+
+/* annealing rule from ChoDro96 page 34
+ * the table is used to map the number of nonzero
+ * states in the neighborhood to the new state
+ */
+static const State anneal[10] = {0, 0, 0, 0, 1, 0, 1, 1, 1, 1};
+
+#endif /* CAPAR_H */
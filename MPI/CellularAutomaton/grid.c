@@ -0,0 +1,73 @@
+#include "grid.h"
+
+int gridSplit(int n, int parts, int i) {
+   return n / parts + (i < n % parts);
+}
+
+/* first element of part i */
+static int gridOffset(int n, int parts, int i) {
+   return i * (n / parts) + (i < n % parts ? i : n % parts);
+}
+
+bool gridCreate(Grid *g, int height, int width, int unit, const int dims[2]) {
+   int nprocs, rank, units = width / unit;
+   int periods[2] = { 1, 1 };
+
+   MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+   if (dims[0] > 0 || dims[1] > 0) {
+      g->dims[0] = dims[0];
+      g->dims[1] = dims[1];
+   } else {
+      /* Halo per process: two lines of the block plus two columns, one
+       * element (unit cells) each. Ties go to fewer columns. */
+      double best = 0;
+      g->dims[0] = 0;
+      for (int py = nprocs;  py >= 1;  py--) {
+         int px = nprocs / py;
+         if (nprocs % py != 0 || py > height || px > units) {
+            continue;
+         }
+         double halo = (double) units / px + (double) height / py;
+         if (g->dims[0] == 0 || halo < best) {
+            g->dims[0] = py;
+            g->dims[1] = px;
+            best = halo;
+         }
+      }
+   }
+   if (g->dims[0] < 1 || g->dims[1] < 1 || g->dims[0] * g->dims[1] != nprocs ||
+       g->dims[0] > height || g->dims[1] > units) {
+      return false;
+   }
+
+   g->height = height;
+   g->width = width;
+   g->unit = unit;
+   MPI_Cart_create(MPI_COMM_WORLD, 2, g->dims, periods, 0, &g->comm);
+   MPI_Cart_coords(g->comm, rank, 2, g->coords);
+   gridBlock(g, rank, &g->y0, &g->lines, &g->x0, &g->cols);
+
+   for (int dy = -1;  dy <= 1;  dy++) {
+      for (int dx = -1;  dx <= 1;  dx++) {
+         int c[2] = { g->coords[0] + dy, g->coords[1] + dx };
+         MPI_Cart_rank(g->comm, c, &g->nb[dy + 1][dx + 1]);
+      }
+   }
+   return true;
+}
+
+void gridBlock(const Grid *g, int rank, int *y0, int *lines, int *x0, int *cols) {
+   int c[2], units = g->width / g->unit;
+
+   MPI_Cart_coords(g->comm, rank, 2, c);
+   *y0 = gridOffset(g->height, g->dims[0], c[0]);
+   *lines = gridSplit(g->height, g->dims[0], c[0]);
+   *x0 = gridOffset(units, g->dims[1], c[1]) * g->unit;
+   *cols = gridSplit(units, g->dims[1], c[1]) * g->unit;
+}
+
+void gridFree(Grid *g) {
+   MPI_Comm_free(&g->comm);
+}
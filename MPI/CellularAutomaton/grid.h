@@ -0,0 +1,42 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <stdbool.h>
+#include "mpi.h"
+
+/* 2D block decomposition of the configuration (capar -g).
+ *
+ * The processes form a Cartesian grid (MPI_Cart_create) of dims[0] rows
+ * times dims[1] columns, periodic in both dimensions like the torus of the
+ * cellular automaton. Every process holds a block of lines and cells and
+ * exchanges its halo with the eight neighbours (see halo.h). Splitting the
+ * lines as well as the cells keeps the halo small compared to the block
+ * once each process holds only a few lines of a wide configuration. */
+
+typedef struct {
+   MPI_Comm comm;     // Cartesian communicator, ranks as in MPI_COMM_WORLD
+   int height, width; // Size of the configuration
+   int unit;          // Blocks are split at multiples of unit cells
+   int dims[2];       // Processes along the lines (0) and along a line (1)
+   int coords[2];     // Position of this process
+   int y0, lines;     // Lines y0 + 1 .. y0 + lines of the configuration
+   int x0, cols;      // Cells x0 + 1 .. x0 + cols of these lines
+   int nb[3][3];      // Neighbour at offset (dy, dx) is nb[dy + 1][dx + 1]
+} Grid;
+
+/* Size of part i of n elements split into parts parts, the first ones get
+ * the remainder */
+int gridSplit(int n, int parts, int i);
+
+/* Create the grid for height lines of width cells. Lines are split into
+ * blocks of multiples of unit cells. dims gives the shape, or { 0, 0 } to
+ * take the one with the smallest halo per process. Returns false if the
+ * processes can't be arranged like this. */
+bool gridCreate(Grid *g, int height, int width, int unit, const int dims[2]);
+
+/* Block of the process rank of the grid, as in Grid */
+void gridBlock(const Grid *g, int rank, int *y0, int *lines, int *x0, int *cols);
+
+void gridFree(Grid *g);
+
+#endif /* GRID_H */
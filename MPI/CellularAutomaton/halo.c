@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capar.h"
+#include "halo.h"
+
+// Tag of the parts moving in direction (dy, dx)
+#define haloTag(dy, dx) (TAG + 3 * ((dy) + 1) + (dx) + 1)
+
+/* first row or column of the own border sent in direction d (-1, 0, 1)
+ * and of the ghost border received from there */
+#define sendStart(d, n, depth) ((d) > 0 ? (n) - (depth) + 1 : 1)
+#define recvStart(d, n, depth) ((d) < 0 ? 1 - (depth) : (d) > 0 ? (n) + 1 : 1)
+
+void haloCreate(Halo *h, const Grid *g, int stride, MPI_Datatype type,
+                int lines, int cols, int maxDepth) {
+   h->g = g;
+   h->stride = stride;
+   h->type = type;
+   h->lines = lines;
+   h->cols = cols;
+   h->maxDepth = maxDepth;
+   h->parts = malloc(maxDepth * sizeof(*h->parts));
+   if (h->parts == NULL) {
+      perror("Could not allocate memory in process.\n");
+      MPI_Abort(MPI_COMM_WORLD, MPI_ERR_UNKNOWN);
+   }
+   for (int d = 0;  d < maxDepth;  d++) {
+      for (int i = 0;  i < 8;  i++) {
+         h->parts[d][i] = MPI_DATATYPE_NULL;
+      }
+   }
+}
+
+void haloStart(Halo *h, void *origin, int depth, MPI_Request req[HALO_REQUESTS]) {
+   const Grid *g = h->g;
+   int stride = h->stride, lines = h->lines, cols = h->cols;
+   MPI_Aint lb, extent;
+   int n = 0, i = 0, self = g->nb[1][1];
+
+   MPI_Type_get_extent(h->type, &lb, &extent);
+
+   for (int dy = -1;  dy <= 1;  dy++) {
+      for (int dx = -1;  dx <= 1;  dx++) {
+         if (dy == 0 && dx == 0) {
+            continue;
+         }
+         int rows = dy ? depth : lines, width = dx ? 1 : cols;
+         int nb = g->nb[dy + 1][dx + 1];
+         char *ghost = (char *) origin + ((MPI_Aint) recvStart(dy, lines, depth) * stride +
+                                          recvStart(dx, cols, 1)) * extent;
+         char *own = (char *) origin + ((MPI_Aint) sendStart(dy, lines, depth) * stride +
+                                        sendStart(dx, cols, 1)) * extent;
+         MPI_Datatype *part = &h->parts[depth - 1][i++];
+
+         if (nb == self) {
+            // The part wraps around to this process, copy the opposite one at once
+            char *wrap = (char *) origin + ((MPI_Aint) sendStart(-dy, lines, depth) * stride +
+                                            sendStart(-dx, cols, 1)) * extent;
+            for (int y = 0;  y < rows;  y++) {
+               memcpy(ghost + (MPI_Aint) y * stride * extent, wrap + (MPI_Aint) y * stride * extent,
+                      width * extent);
+            }
+            req[n++] = MPI_REQUEST_NULL;
+            req[n++] = MPI_REQUEST_NULL;
+         } else {
+            if (*part == MPI_DATATYPE_NULL) {
+               MPI_Type_vector(rows, width, stride, h->type, part);
+               MPI_Type_commit(part);
+            }
+            MPI_Irecv(ghost, 1, *part, nb, haloTag(-dy, -dx), g->comm, &req[n++]);
+            MPI_Isend(own, 1, *part, nb, haloTag(dy, dx), g->comm, &req[n++]);
+         }
+      }
+   }
+}
+
+void haloWait(MPI_Request req[HALO_REQUESTS], double *exposed) {
+   double start = MPI_Wtime();
+
+   MPI_Waitall(HALO_REQUESTS, req, MPI_STATUSES_IGNORE);
+   *exposed += MPI_Wtime() - start;
+}
+
+void haloFree(Halo *h) {
+   for (int d = 0;  d < h->maxDepth;  d++) {
+      for (int i = 0;  i < 8;  i++) {
+         if (h->parts[d][i] != MPI_DATATYPE_NULL) {
+            MPI_Type_free(&h->parts[d][i]);
+         }
+      }
+   }
+   free(h->parts);
+}
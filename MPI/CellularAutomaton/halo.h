@@ -0,0 +1,53 @@
+#ifndef HALO_H
+#define HALO_H
+
+#include "mpi.h"
+#include "grid.h"
+
+/* Halo exchange with the eight neighbours of the grid (see grid.h).
+ *
+ * haloStart posts the receives of the ghost lines, the ghost columns and
+ * the ghost corners and the sends of the own border with MPI_Irecv /
+ * MPI_Isend and returns at once. Each part is described by a derived
+ * datatype (MPI_Type_vector over the rows of the block), so nothing is
+ * copied into message buffers, and the wraparound at the borders of the
+ * configuration is just the exchange with the periodic neighbour, possibly
+ * this process itself. Every direction has a tag of its own, so the
+ * exchange can't mix up the parts even if several neighbours are the same
+ * process, and nothing depends on the eager buffering of MPI_Send. Parts
+ * whose neighbour is this process are copied at once; with a single column
+ * of processes (dims[1] == 1) the ghost columns are ready when haloStart
+ * returns.
+ *
+ * With capar -x overlap (the default) the cells that need no ghost cell are
+ * calculated while the messages travel; haloWait then waits for them, after
+ * which the border of the block is calculated. capar -x blocking waits at
+ * once. */
+
+#define HALO_REQUESTS 16
+
+/* The block is an array of elements of type with stride elements per row;
+ * the origin passed to haloStart is the ghost corner above and left of the
+ * first own element, which is row 1, column 1. The own rows are 1..lines
+ * and the own columns 1..cols. depth rows (up to maxDepth) are exchanged
+ * with the neighbours above and below (deep halo, see packed.h), one column
+ * with those to the left and right. The datatypes of the parts are built
+ * and committed the first time a depth is used and kept until haloFree. */
+typedef struct {
+   const Grid *g;
+   int stride, lines, cols, maxDepth;
+   MPI_Datatype type;
+   MPI_Datatype (*parts)[8]; // parts[depth - 1][direction], MPI_DATATYPE_NULL until used
+} Halo;
+
+void haloCreate(Halo *h, const Grid *g, int stride, MPI_Datatype type,
+                int lines, int cols, int maxDepth);
+
+void haloStart(Halo *h, void *origin, int depth, MPI_Request req[HALO_REQUESTS]);
+
+/* Wait for the requests of haloStart and add the time waited to *exposed */
+void haloWait(MPI_Request req[HALO_REQUESTS], double *exposed);
+
+void haloFree(Halo *h);
+
+#endif /* HALO_H */
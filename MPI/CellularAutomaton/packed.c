@@ -0,0 +1,288 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpi.h"
+#include "halo.h"
+#include "packed.h"
+
+/* Word w of line y of a packed block with stride words per line.
+ * Lines 1 - maxDepth .. lines + maxDepth, words -1 .. words + 2 exist. */
+#define word(b, stride, y, w) ((b)[(ptrdiff_t) (y) * (stride) + (w)])
+
+/* store the cells 1..cols of lines 1..lines of a block as bits */
+static void packBlock(const State *block, int lines, int cols, Word *packed, int stride) {
+   for (int y = 1;  y <= lines;  y++) {
+      const State *line = &block[(size_t) y * (cols + 2)];
+      for (int w = 1;  w <= cols / 64;  w++) {
+         Word bits = 0;
+         for (int b = 0;  b < 64;  b++) {
+            bits |= (Word) (line[64 * (w - 1) + b + 1] != 0) << b;
+         }
+         word(packed, stride, y, w) = bits;
+      }
+   }
+}
+
+static void unpackBlock(const Word *packed, int stride, State *block, int lines, int cols) {
+   for (int y = 1;  y <= lines;  y++) {
+      State *line = &block[(size_t) y * (cols + 2)];
+      for (int w = 1;  w <= cols / 64;  w++) {
+         for (int b = 0;  b < 64;  b++) {
+            line[64 * (w - 1) + b + 1] = (word(packed, stride, y, w) >> b) & 1;
+         }
+      }
+   }
+}
+
+/* full adder on 64 bit slices: s = a + b + c mod 2, k = carry */
+#define fullAdd(a, b, c, s, k) do { \
+      Word t_ = (a) ^ (b);          \
+      (s) = t_ ^ (c);               \
+      (k) = ((a) & (b)) | (t_ & (c)); \
+   } while (0)
+
+/* all ones if a table entry is set */
+static inline Word pick(State bit) {
+   return bit ? ~(Word) 0 : 0;
+}
+
+/* select one where c is set, zero elsewhere */
+static inline Word mux(Word c, Word one, Word zero) {
+   return (c & one) | (~c & zero);
+}
+
+/* new states of 64 cells from the bits c0 (1) .. c3 (8) of their count:
+ * anneal as a tree of selections on the count bits. The table is constant,
+ * so the tree is folded into a few word operations. Counts above 9 don't
+ * occur; they select the entries of 8 and 9, so c1 and c2 drop out there. */
+static inline Word rule(Word c0, Word c1, Word c2, Word c3) {
+   Word low = mux(c2, mux(c1, mux(c0, pick(anneal[7]), pick(anneal[6])),
+                              mux(c0, pick(anneal[5]), pick(anneal[4]))),
+                      mux(c1, mux(c0, pick(anneal[3]), pick(anneal[2])),
+                              mux(c0, pick(anneal[1]), pick(anneal[0]))));
+   Word high = mux(c0, pick(anneal[9]), pick(anneal[8]));
+
+   return mux(c3, high, low);
+}
+
+/* sum of the left, own and right neighbour of every cell of the words
+ * first..last of a line as bit slices s0 (1) and s1 (2) */
+static void lineSum(const Word *restrict line, Word *restrict s0, Word *restrict s1,
+                    int first, int last) {
+   for (int w = first;  w <= last;  w++) {
+      Word c = line[w];
+      Word l = (c << 1) | (line[w - 1] >> 63);
+      Word r = (c >> 1) | (line[w + 1] << 63);
+      fullAdd(l, c, r, s0[w], s1[w]);
+   }
+}
+
+/* make one simulation iteration on the words first..last of the lines
+ * top..bot, like simulate. The line sums are calculated once per line and
+ * kept for the next two lines, in sums (6 * (words + 2) words). */
+static void iterate(const Word *restrict from, Word *restrict to, int stride, Word *restrict sums,
+                    int top, int bot, int first, int last) {
+   int n = stride - 2;
+   Word *a0 = sums,         *a1 = sums + n;       // Line sums of y - 1
+   Word *b0 = sums + 2 * n, *b1 = sums + 3 * n;   // y
+   Word *c0 = sums + 4 * n, *c1 = sums + 5 * n;   // y + 1
+   Word *t;
+
+   if (top > bot || first > last) {
+      return;
+   }
+   lineSum(&word(from, stride, top - 1, 0), a0, a1, first, last);
+   lineSum(&word(from, stride, top, 0), b0, b1, first, last);
+
+   for (int y = top;  y <= bot;  y++) {
+      Word *restrict out = &word(to, stride, y, 0);
+
+      lineSum(&word(from, stride, y + 1, 0), c0, c1, first, last);
+
+      // Six distinct rows of sums
+      const Word *restrict p0 = a0, *restrict p1 = a1, *restrict q0 = b0;
+      const Word *restrict q1 = b1, *restrict r0 = c0, *restrict r1 = c1;
+      for (int w = first;  w <= last;  w++) {
+         Word n0, k1, t0, t1;
+
+         // Weight 1: three bits give the count bit 1 and a carry of weight 2
+         fullAdd(p0[w], q0[w], r0[w], n0, k1);
+         // Weight 2: three bits plus the carry, 0..4 times 2
+         fullAdd(p1[w], q1[w], r1[w], t0, t1);
+         Word n1 = t0 ^ k1, k2 = t0 & k1;
+         Word n2 = t1 ^ k2, n3 = t1 & k2;
+
+         out[w] = rule(n0, n1, n2, n3);
+      }
+
+      // The sums of y and y + 1 are those of y - 1 and y of the next line
+      t = a0;  a0 = b0;  b0 = c0;  c0 = t;
+      t = a1;  a1 = b1;  b1 = c1;  c1 = t;
+   }
+}
+
+/* iterate on the lines top..bot, words first..last except the inner part
+ * (lines 2..lines - 1, words inFirst..inLast) calculated during the exchange */
+static void iterateBorder(const Word *from, Word *to, int stride, Word *sums, int lines,
+                          int top, int bot, int first, int last, int inFirst, int inLast) {
+   if (lines < 3 || inFirst > inLast) {
+      iterate(from, to, stride, sums, top, bot, first, last);
+      return;
+   }
+   iterate(from, to, stride, sums, top, 1, first, last);
+   iterate(from, to, stride, sums, lines, bot, first, last);
+   iterate(from, to, stride, sums, 2, lines - 1, first, inFirst - 1);
+   iterate(from, to, stride, sums, 2, lines - 1, inLast + 1, last);
+}
+
+/* Pick the halo depth from 1..maxDepth with the smallest modelled time per
+ * iteration. Measured on every process and combined (slowest values), so all
+ * processes pick the same depth:
+ *   alpha  latency of an exchange, beta  time per exchanged line,
+ *   line   time to calculate one line.
+ * An exchange of k lines every k iterations costs (alpha + beta * k) / k per
+ * iteration, with overlap only the part not hidden behind the lines - 2
+ * inner lines. The ghost lines cost k - 1 redundant lines per iteration. */
+static int tuneDepth(const Grid *g, Halo *halo, Word *cur, Word *next, int stride, Word *sums,
+                     int maxDepth, bool overlap) {
+   MPI_Request req[HALO_REQUESTS];
+   double t, m[3], all[3], none = 0;
+   int minLines, best = 1, lines = g->lines;
+
+   if (maxDepth <= 1) {
+      return 1;
+   }
+
+   // Exchanges of 1 and maxDepth lines
+   double t1 = 0, tk = 0;
+   MPI_Barrier(g->comm);
+   for (int r = 0;  r < TUNE_REPS;  r++) {
+      t = MPI_Wtime();
+      haloStart(halo, cur, 1, req);
+      haloWait(req, &none);
+      t1 += MPI_Wtime() - t;
+      t = MPI_Wtime();
+      haloStart(halo, cur, maxDepth, req);
+      haloWait(req, &none);
+      tk += MPI_Wtime() - t;
+   }
+   t = MPI_Wtime();
+   for (int r = 0;  r < TUNE_REPS;  r++) {
+      iterate(cur, next, stride, sums, 1, lines, 1, stride - 4);
+   }
+   m[2] = (MPI_Wtime() - t) / TUNE_REPS / lines;
+   m[1] = (tk - t1) / TUNE_REPS / (maxDepth - 1);
+   m[0] = t1 / TUNE_REPS - m[1];
+   m[1] = (m[1] > 0) ? m[1] : 0;
+   m[0] = (m[0] > 0) ? m[0] : 0;
+
+   MPI_Allreduce(m, all, 3, MPI_DOUBLE, MPI_MAX, g->comm);
+   MPI_Allreduce(&lines, &minLines, 1, MPI_INT, MPI_MIN, g->comm);
+
+   double alpha = all[0], beta = all[1], line = all[2], bestTime = 0;
+   for (int k = 1;  k <= maxDepth;  k++) {
+      double comm = alpha + beta * k;
+      if (overlap) {
+         comm -= (minLines - 2) * line;
+         comm = (comm > 0) ? comm : 0;
+      }
+      double time = comm / k + (k - 1) * line;
+      if (k == 1 || time < bestTime) {
+         best = k;
+         bestTime = time;
+      }
+   }
+   return best;
+}
+
+int simulatePacked(const Grid *g, State *block, int its, bool overlap,
+                   int depth, int maxDepth, double *exposed) {
+   int lines = g->lines, cols = g->cols, words = cols / 64;
+   int stride = words + 4;
+   size_t size = (size_t) (lines + 2 * maxDepth) * stride;
+   Word *current, *next, *temp, *sums;
+   State (*edges)[2];   // Border cells the byte engine would set, two sets of lines
+
+   current = calloc(size, sizeof(Word));
+   next = calloc(size, sizeof(Word));
+   sums = malloc(6 * (words + 2) * sizeof(Word));
+   edges = calloc(2 * (size_t) lines, sizeof(*edges));
+   if (current == NULL || next == NULL || sums == NULL || edges == NULL) {
+      perror("Could not allocate memory in process.\n");
+      MPI_Abort(MPI_COMM_WORLD, MPI_ERR_UNKNOWN);
+   }
+   Word *freeCurrent = current, *freeNext = next;
+
+   /* current points to word 0 of line 0, the ghost corner of halo.h.
+    * sums is indexed like the words of a line, from ghost word 0 on. */
+   current += (ptrdiff_t) (maxDepth - 1) * stride + 1;
+   next += (ptrdiff_t) (maxDepth - 1) * stride + 1;
+
+   packBlock(block, lines, cols, current, stride);
+
+   Halo halo;
+   haloCreate(&halo, g, stride, MPI_UINT64_T, lines, words, maxDepth);
+
+   if (depth == 0) {
+      depth = tuneDepth(g, &halo, current, next, stride, sums, maxDepth, overlap);
+   }
+
+   /* Every depth iterations the ghost lines for the next (up to) depth
+    * iterations are exchanged. r more iterations follow in the current phase,
+    * so the lines 1 - r .. lines + r are calculated, and the ghost words too
+    * (their cells next to the block stay valid for up to 63 iterations). */
+   int r = 0;
+   for (int i = 0;  i < its;  i++, r--) {
+      MPI_Request req[HALO_REQUESTS];
+      bool exchange = i % depth == 0;
+
+      if (exchange) {
+         r = ((its - i < depth) ? its - i : depth) - 1;
+         haloStart(&halo, current, r + 1, req);
+         if (!overlap) {
+            haloWait(req, exposed);
+         }
+      }
+
+      int first = r > 0 ? 0 : 1, last = r > 0 ? words + 1 : words;
+      if (overlap && exchange) {
+         // Words that need no ghost word, all if the ghost words are copied at once
+         int inFirst = (g->dims[1] == 1) ? first : 2, inLast = (g->dims[1] == 1) ? last : words - 1;
+
+         iterate(current, next, stride, sums, 2, lines - 1, inFirst, inLast);
+         haloWait(req, exposed);
+         iterateBorder(current, next, stride, sums, lines, 1 - r, lines + r, first, last, inFirst, inLast);
+      } else {
+         iterate(current, next, stride, sums, 1 - r, lines + r, first, last);
+      }
+
+      // The byte engine has the cells next to the block in the border of this buffer
+      State (*e)[2] = &edges[(i % 2) * lines];
+      for (int y = 1;  y <= lines;  y++) {
+         e[y - 1][0] = word(current, stride, y, 0) >> 63;
+         e[y - 1][1] = word(current, stride, y, words + 1) & 1;
+      }
+
+      temp = current;
+      current = next;
+      next = temp;
+   }
+   /* The byte engine never writes the border of the buffer it writes to, so
+    * the result holds the border of two iterations before (none after one) */
+   if (its > 0) {
+      State (*e)[2] = &edges[(its % 2) * lines];
+      unpackBlock(current, stride, block, lines, cols);
+      for (int y = 1;  y <= lines;  y++) {
+         block[(size_t) y * (cols + 2)] = e[y - 1][0];
+         block[(size_t) y * (cols + 2) + cols + 1] = e[y - 1][1];
+      }
+   }
+
+   haloFree(&halo);
+   free(freeCurrent);
+   free(freeNext);
+   free(sums);
+   free(edges);
+   return depth;
+}
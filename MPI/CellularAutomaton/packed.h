@@ -0,0 +1,48 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "capar.h"
+#include "grid.h"
+
+/* Bit-packed engine (the default, capar -e packed).
+ *
+ * A line of a block holds 64 cells per word: cell x (1..cols) is bit
+ * (x-1) % 64 of word (x-1) / 64 + 1. Word 0 and word words + 1 are ghost
+ * words holding the 64 cells to the left and right from the neighbours
+ * (see halo.h), the word beyond each is always zero. The neighbourhood
+ * count of 64 cells at once is a 4 bit number calculated with full adders
+ * on whole words (bit slices): first the sum of the left, own and right
+ * cell of every line, then the sum of three such sums. anneal is applied to
+ * the four bits of the count as a boolean function, built from the table at
+ * compile time.
+ *
+ * Halo lines are exchanged packed, cols / 8 bytes instead of cols + 2, and
+ * optionally several at once (deep halo, see simulatePacked). The blocks
+ * are split at multiples of 64 cells, so the width of the configuration
+ * has to be one too. */
+
+#define MAX_DEPTH 64     // Deepest halo the auto-tuner tries, at most the 64 cells of a ghost word
+#define TUNE_REPS 10     // Measurements of the auto-tuner
+
+typedef uint64_t Word;
+
+/* Run its iterations on the block of this process of the grid g. block
+ * holds the lines 0..lines + 1 of cols + 2 cells (the own cells and the
+ * border like the byte engine). Afterwards it holds the lines exactly as
+ * the byte engine leaves them, including the border cells. overlap selects
+ * the non-blocking halo exchange of halo.h, otherwise the halo is exchanged
+ * before the iterations that need it.
+ *
+ * depth ghost lines are exchanged every depth iterations (deep halo); in
+ * between the processes calculate their lines and, redundantly, the part
+ * of the ghost lines and ghost words the following iterations still need.
+ * depth == 0 picks the depth (at most maxDepth, which has to be <= lines on
+ * all processes) from measured latency, bandwidth and calculation speed.
+ * The depth used is returned. The time spent waiting for the halo is added
+ * to *exposed. */
+int simulatePacked(const Grid *g, State *block, int its, bool overlap,
+                   int depth, int maxDepth, double *exposed);
+
+#endif /* PACKED_H */
@@ -56,7 +56,7 @@ Float64 nextRandomParkMiller(void)
 #define IR1 12211
 #define IR2 3791
 
-#define NTAB 32
+#define NTAB NTAB_LECUYER
 #define NDIV (1+IMM1/NTAB)
 
 static Int32 state1 = 987654321;
@@ -93,6 +93,28 @@ void initRandomLEcuyer(Int32 seed)
   initRandomTabLEcuyer();
 }
 
+/* ------------------------------------------------------------------ */
+void getStateLEcuyer(StateLEcuyer *s)
+{
+  int j;
+
+  s->state1 = state1;
+  s->state2 = state2;
+  s->y = y;
+  for (j=0;  j<NTAB;  j++) { s->v[j] = v[j]; }
+}
+
+/* ------------------------------------------------------------------ */
+void setStateLEcuyer(const StateLEcuyer *s)
+{
+  int j;
+
+  state1 = s->state1;
+  state2 = s->state2;
+  y = s->y;
+  for (j=0;  j<NTAB;  j++) { v[j] = s->v[j]; }
+}
+
 /* ------------------------------------------------------------------ */
 static Int32 power(Int32 base, Card64 exp, Int32 modulus)
 {
@@ -66,6 +66,23 @@ CC Float64 nextRandomParkMiller (void);
 CC void initRandomLEcuyer(Int32 seed);
 CC Float64 nextRandomLEcuyer (void);
 
+/* The complete state of the lEcuyer RNG, i.e. the two generators plus
+ *    the shuffle table. It may be handed to another PE (as plain bytes)
+ *    which then continues the very same sequence of numbers.
+ * Please note: the shuffle table depends on all numbers drawn so far,
+ *    so unlike the two generators (see initParallelRandomLEcuyer) the
+ *    sequence can't be forwarded by a number of steps without drawing them.
+ */
+#define NTAB_LECUYER 32
+
+typedef struct {
+  Int32 state1, state2, y;
+  Int32 v[NTAB_LECUYER];
+} StateLEcuyer;
+
+CC void getStateLEcuyer(StateLEcuyer *s);
+CC void setStateLEcuyer(const StateLEcuyer *s);
+
 
 /* ------------------------------------------------------------------ */
 /*
@@ -0,0 +1,40 @@
+#include "block.h"
+
+/* A BLOCK_K x BLOCK_N block of B stays in the cache while the BLOCK_M rows
+ * of A of a block of C are multiplied with it */
+#define BLOCK_M 32
+#define BLOCK_K 128
+#define BLOCK_N 128
+
+// Smaller products are not worth starting the threads
+#define BLOCK_MIN_PARALLEL (64L * 64 * 64)
+
+void block_mult(int m, int n, int k, const double *a, size_t lda,
+                const double *b, size_t ldb, double *c, size_t ldc)
+{
+    int i0, j0;
+
+    // The blocks of C are independent, each one is calculated by one thread
+    #pragma omp parallel for collapse(2) schedule(static) if ((long) m * n * k >= BLOCK_MIN_PARALLEL)
+    for (i0 = 0; i0 < m; i0 += BLOCK_M) {
+        for (j0 = 0; j0 < n; j0 += BLOCK_N) {
+            int i, j, x, k0, k1;
+            int i1 = (m - i0 > BLOCK_M) ? i0 + BLOCK_M : m;
+            int j1 = (n - j0 > BLOCK_N) ? j0 + BLOCK_N : n;
+
+            for (k0 = 0; k0 < k; k0 = k1) {
+                k1 = (k - k0 > BLOCK_K) ? k0 + BLOCK_K : k;
+                for (i = i0; i < i1; ++i) {
+                    double *ci = &c[i * ldc];
+                    for (x = k0; x < k1; ++x) {
+                        const double *bx = &b[x * ldb];
+                        double aix = a[i * lda + x];
+                        for (j = j0; j < j1; ++j) {
+                            ci[j] += aix * bx[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stddef.h>
+
+/* Local multiplication of blocks of doubles, used by all distributions.
+ * The blocks of C are calculated in parallel by the OpenMP threads of the
+ * process (hybrid mode, see mmul_mpi -t).
+ *
+ * C += A * B for the m x k matrix A and the k x n matrix B, all row major
+ * with the given leading dimensions. The loops are blocked for the cache,
+ * but every element of C still gets its products added in order of
+ * increasing k, like the plain triple loop, so the results are the same. */
+void block_mult(int m, int n, int k, const double *a, size_t lda,
+                const double *b, size_t ldb, double *c, size_t ldc);
+
+#endif /* BLOCK_H */
@@ -1,106 +1,152 @@
 #include <mpi.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <pthread.h>
+#include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+#include "bench.h"
+#include "freivalds.h"
+#include "block.h"
+#include "matfile.h"
+#include "matwrite.h"
+#include "pipeline.h"
+#include "summa.h"
+#include "verify.h"
 
 #define TAG 123
 
 typedef double matrix_elem_t;
 
+/* How the work is distributed, selected with -m */
+typedef enum {
+  DIST_ROWS,      // Rank 0 sends blocks of rows to the others and collects the results
+  DIST_SUMMA,     // SUMMA on a 2D grid, see summa.h
+  DIST_PIPELINE   // Rows sent in pipelined panels, see pipeline.h
+} distribution;
+
+static const char *dist_names[] = { "rows", "summa", "pipeline" };
+
 /* Matrix can only hold nxn matrices.
  * No need to hold both dimenstions. */
 typedef struct {
   int dim;
   matrix_elem_t *data;
+  matfile_t file; // Mapped binary file if data points into it
 } matrix_t;
 
-/* This function intializes a given Matrix by the scheme of
- *  m_ij = (i / j+1) */
-void initialize_matrix(matrix_t mat) {
+/* This function intializes the block [r0, r1) x [c0, c1) of a Matrix by the
+ * scheme of m_ij = (i / j+1). The block is stored row major in dst, so every
+ * process can generate just the part it needs. */
+void initialize_block(matrix_elem_t *dst, int r0, int r1, int c0, int c1) {
     int i, j;
-    for (i = 0; i < mat.dim; ++i) {
-      for (j = 0; j < mat.dim; ++j) {
+    for (i = r0; i < r1; ++i) {
+      for (j = c0; j < c1; ++j) {
         // Division by 0 cannot happen. No extra check.
-        mat.data[(i * mat.dim) + j] = ((double)i / (j + 1));
+        dst[(size_t) (i - r0) * (c1 - c0) + (j - c0)] = ((double)i / (j + 1));
       }
     }
 }
 
-// Prints the matrix to a file
-void print_matrix(matrix_t m) {
-  int i, j;
-  FILE *result;
-  result = fopen("c.txt", "w");
-  if (result == NULL) {
-    perror("Could not create file!");
-    exit(EXIT_FAILURE);
-  }
-
-  for (i = 0; i < m.dim; ++i) {
-    for (j = 0; j < m.dim; ++j) {
-      fprintf(result, "%lf\t ", m.data[(i * m.dim) + j]);
+/* Allocates rows x cols elements or exits */
+matrix_elem_t *alloc_elems(size_t rows, size_t cols) {
+    matrix_elem_t *data = malloc((rows * cols + 1) * sizeof(matrix_elem_t));
+    if (data == NULL) {
+      perror("Could not allocate memory.");
+      exit(EXIT_FAILURE);
     }
-    fprintf(result, "\n");
-  }
-  fclose(result);
+    return data;
 }
 
-int main(int argc, char ** argv) {
-
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <dimension>\n", argv[0]);
-        return EXIT_FAILURE;
+/* Maps a binary nxn matrix (see matfile.h). Row major doubles are used in place,
+ * other element types or layouts are converted into a newly allocated matrix. */
+bool read_matrix(char *filepath, matrix_t *mat) {
+    if (!matfile_open(filepath, &mat->file)) {
+      return false;
     }
 
-    int dim = (int) strtol(argv[1], NULL, 0);
-
-    matrix_t A = {dim, NULL};
-    matrix_t B = {dim, NULL};
-    matrix_t R = {dim, NULL};
+    if (mat->file.hdr.rows != mat->file.hdr.cols) {
+      fprintf(stderr, "%s: only nxn matrices are supported\n", filepath);
+      matfile_close(&mat->file);
+      return false;
+    }
+    mat->dim = (int) mat->file.hdr.rows;
 
-    A.data = calloc(dim * dim, sizeof(matrix_elem_t));
-    if (A.data == NULL) {
-        perror("Could not allocate memory.");
-        exit(EXIT_FAILURE);
+    if (matfile_matches(&mat->file, MATFILE_DOUBLE, false)) {
+      mat->data = mat->file.data;
+      return true;
     }
 
-    B.data = calloc(dim * dim, sizeof(matrix_elem_t));
-    if (A.data == NULL) {
-        perror("Could not allocate memory.");
-        exit(EXIT_FAILURE);
+    mat->data = malloc((size_t) mat->dim * mat->dim * sizeof(matrix_elem_t));
+    if (mat->data != NULL) {
+      matfile_load_block(&mat->file, MATFILE_DOUBLE, false, 0, mat->dim, 0, mat->dim, mat->data, mat->dim);
     }
+    matfile_close(&mat->file);
+    return mat->data != NULL;
+}
 
-    R.data = calloc(dim * dim, sizeof(matrix_elem_t));
-    if (A.data == NULL) {
-        perror("Could not allocate memory.");
-        exit(EXIT_FAILURE);
+void free_matrix(matrix_t *mat) {
+    if (mat->file.map != NULL) {
+      matfile_close(&mat->file);
+    } else {
+      free(mat->data);
     }
+    mat->data = NULL;
+}
 
-    initialize_matrix(A);
-    initialize_matrix(B);
-    
+/* Writes the result: as text to c.txt (MATWRITE_TEXT), as binary matrix to
+ * c.mat (MATWRITE_BINARY) or only its sum and hash to stdout (MATWRITE_SUM). */
+void print_matrix(matrix_t m, matwrite_mode mode) {
+  size_t i, count = (size_t) m.dim * m.dim;
+  double sum = 0.0;
 
-    MPI_Init(&argc, &argv);
+  if (mode == MATWRITE_SUM) {
+    for (i = 0; i < count; ++i) {
+      sum += m.data[i];
+    }
+    printf("sum: %lf\nhash: %016llx\n", sum, (unsigned long long) matwrite_hash(m.data, count));
+    return;
+  }
 
-    int nprocs, rank;
-    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int result = open(mode == MATWRITE_TEXT ? "c.txt" : "c.mat", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (result < 0) {
+    perror("Could not create file!");
+    exit(EXIT_FAILURE);
+  }
 
-    MPI_Bcast(B.data , dim * dim, MPI_DOUBLE , 0, MPI_COMM_WORLD);
-    MPI_Bcast(R.data , dim * dim, MPI_DOUBLE , 0, MPI_COMM_WORLD);
+  bool ok;
+  if (mode == MATWRITE_TEXT) {
+    ok = matwrite_text_double(result, m.data, m.dim, m.dim, 1);
+  } else {
+    ok = matwrite_binary(result, MATFILE_DOUBLE, m.data, m.dim, m.dim);
+  }
+  if (!ok) {
+    exit(EXIT_FAILURE);
+  }
+  close(result);
+}
 
+/* Multiplies A and B into R: the main process sends blocks of rows of A to
+ * the other processes and, if gather is set, collects their rows of R. On
+ * the main process A and R hold all rows (R is not needed without gather),
+ * on the others only the rows they calculate (see worker_rows). B has to be
+ * known to all processes but the main one. */
+void matrix_mult(matrix_t A, matrix_t B, matrix_t R, int rank, int nprocs, bool gather) {
+    int dim = B.dim;
     int rows_per_proc = dim / (nprocs - 1); // Number of rows each process shall calculate
     int remainder = dim % (nprocs - 1); // Number of rows left over
 
-    double start, elapsed, time;
-    MPI_Barrier(MPI_COMM_WORLD);
-    start = MPI_Wtime();
-
-    // Main process 
+    // Main process
     if (!rank) {
 
         // Send the corresponding rows to each process
@@ -115,7 +161,7 @@ int main(int argc, char ** argv) {
 
         // Receive the results from the corresponding processes
         MPI_Status status;
-        for (int i = 1; i < nprocs; i++) {
+        for (int i = 1; i < nprocs && gather; i++) {
             if (i != (nprocs - 1)) {
                 MPI_Recv(&R.data[(i - 1) * rows_per_proc * dim], rows_per_proc * dim, MPI_DOUBLE, i, TAG , MPI_COMM_WORLD, &status);
             } else {
@@ -126,47 +172,438 @@ int main(int argc, char ** argv) {
     } else if (rank == (nprocs - 1)) {
         // Last process has some differences in the way the result is calculated due to the remainder.
         MPI_Status status;
-        MPI_Recv(&A.data[(rank - 1) * rows_per_proc * dim], (rows_per_proc + remainder) * dim, MPI_DOUBLE, 0, TAG, MPI_COMM_WORLD, &status);
-
-        matrix_elem_t sum;
-        for (int i = 0; i < (rows_per_proc + remainder); i++) {
-            for(int j = 0; j < dim; j++) {
-                sum = 0.0;
-                for (int x = 0; x < dim; x++) {
-                    sum += A.data[((rank - 1) * rows_per_proc * dim) + (i * dim) + x] * B.data[x * dim + j];
-                }
-                R.data[((rank - 1) * rows_per_proc * dim) + (i * dim) + j] = sum;
-            }
-        }
+        MPI_Recv(A.data, (rows_per_proc + remainder) * dim, MPI_DOUBLE, 0, TAG, MPI_COMM_WORLD, &status);
 
-        MPI_Send(&R.data[(rank - 1) * rows_per_proc * dim], (rows_per_proc + remainder) * dim, MPI_DOUBLE, 0, TAG, MPI_COMM_WORLD);
+        memset(R.data, 0, (size_t) (rows_per_proc + remainder) * dim * sizeof(matrix_elem_t));
+        block_mult(rows_per_proc + remainder, dim, dim, A.data, dim, B.data, dim, R.data, dim);
+
+        if (gather) {
+            MPI_Send(R.data, (rows_per_proc + remainder) * dim, MPI_DOUBLE, 0, TAG, MPI_COMM_WORLD);
+        }
     } else {
         // All the worker processes have to calculate the corresponding rows
 
         MPI_Status status;
-        MPI_Recv(&A.data[(rank - 1) * rows_per_proc * dim], rows_per_proc * dim, MPI_DOUBLE, 0, TAG, MPI_COMM_WORLD, &status);
-
-        matrix_elem_t sum;
-        for (int i = 0; i < rows_per_proc; i++) {
-            for (int j = 0; j < dim; j++) {
-                sum = 0.0;
-                for (int x = 0; x < dim; x++) {
-                    sum += A.data[((rank - 1) * rows_per_proc * dim) + (i * dim) + x] * B.data[x * dim + j];
-                }
-                R.data[((rank - 1) * rows_per_proc * dim) + (i * dim) + j] = sum;
+        MPI_Recv(A.data, rows_per_proc * dim, MPI_DOUBLE, 0, TAG, MPI_COMM_WORLD, &status);
+
+        memset(R.data, 0, (size_t) rows_per_proc * dim * sizeof(matrix_elem_t));
+        block_mult(rows_per_proc, dim, dim, A.data, dim, B.data, dim, R.data, dim);
+
+        if (gather) {
+            MPI_Send(R.data, rows_per_proc * dim, MPI_DOUBLE, 0, TAG, MPI_COMM_WORLD);
+        }
+    }
+}
+
+/* Number of rows of A and R a worker process of the row distribution calculates */
+int worker_rows(int dim, int rank, int nprocs) {
+    return dim / (nprocs - 1) + (rank == nprocs - 1 ? dim % (nprocs - 1) : 0);
+}
+
+/* Copies the block [r0, r1) x [c0, c1) of the nxn matrix m to dst */
+void copy_block(matrix_t m, int r0, int r1, int c0, int c1, matrix_elem_t *dst) {
+    for (int i = r0; i < r1; i++) {
+      memcpy(&dst[(size_t) (i - r0) * (c1 - c0)], &m.data[(size_t) i * m.dim + c0], (c1 - c0) * sizeof(matrix_elem_t));
+    }
+}
+
+/* Collects the SUMMA blocks of R of all processes in R on rank 0 */
+void gather_blocks(summa_grid *g, const matrix_elem_t *local, matrix_t R) {
+    int rank, nprocs;
+    MPI_Comm_rank(g->grid, &rank);
+    MPI_Comm_size(g->grid, &nprocs);
+
+    if (rank) {
+      MPI_Send(local, (g->r1 - g->r0) * (g->c1 - g->c0), MPI_DOUBLE, 0, TAG, g->grid);
+      return;
+    }
+
+    for (int p = 0; p < nprocs; p++) {
+      int coords[2], sizes[2] = {R.dim, R.dim}, sub[2], starts[2];
+      MPI_Cart_coords(g->grid, p, 2, coords);
+      starts[0] = summa_split(R.dim, g->rows, coords[0]);
+      starts[1] = summa_split(R.dim, g->cols, coords[1]);
+      sub[0] = summa_split(R.dim, g->rows, coords[0] + 1) - starts[0];
+      sub[1] = summa_split(R.dim, g->cols, coords[1] + 1) - starts[1];
+      if (sub[0] == 0 || sub[1] == 0) {
+        continue;
+      }
+
+      // The block is received directly into its place in R
+      MPI_Datatype block;
+      MPI_Type_create_subarray(2, sizes, sub, starts, MPI_ORDER_C, MPI_DOUBLE, &block);
+      MPI_Type_commit(&block);
+      if (p == 0) {
+        MPI_Sendrecv(local, sub[0] * sub[1], MPI_DOUBLE, 0, TAG, R.data, 1, block, 0, TAG, g->grid, MPI_STATUS_IGNORE);
+      } else {
+        MPI_Recv(R.data, 1, block, p, TAG, g->grid, MPI_STATUS_IGNORE);
+      }
+      MPI_Type_free(&block);
+    }
+}
+
+/* Writes the nxn result into the binary matrix file path (see matfile.h)
+ * with collective MPI-IO. Every process passes the block [r0, r1) x [c0, c1)
+ * of R it holds (an empty one if it holds nothing), which is placed in the
+ * file by a subarray file view; rank 0 also writes the header. */
+void write_blocks(const char *path, int dim, int r0, int r1, int c0, int c1, const matrix_elem_t *block) {
+    int rank, count = (r1 - r0) * (c1 - c0);
+    matfile_header hdr;
+    MPI_File fh;
+    MPI_Datatype view = MPI_DOUBLE;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    matfile_init_header(&hdr, MATFILE_DOUBLE, dim, dim, 0);
+
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+      fprintf(stderr, "Could not create %s\n", path);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    // Also cuts off the rest of an older, larger file
+    MPI_File_set_size(fh, (MPI_Offset) (hdr.data_offset + (uint64_t) dim * dim * sizeof(matrix_elem_t)));
+    if (!rank && MPI_File_write_at(fh, 0, &hdr, sizeof(hdr), MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+      fprintf(stderr, "Could not write %s\n", path);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+
+    if (count > 0) {
+      int sizes[2] = {dim, dim}, sub[2] = {r1 - r0, c1 - c0}, starts[2] = {r0, c0};
+      MPI_Type_create_subarray(2, sizes, sub, starts, MPI_ORDER_C, MPI_DOUBLE, &view);
+      MPI_Type_commit(&view);
+    }
+    MPI_File_set_view(fh, (MPI_Offset) hdr.data_offset, MPI_DOUBLE, view, "native", MPI_INFO_NULL);
+    if (MPI_File_write_at_all(fh, 0, block, count, MPI_DOUBLE, MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+      fprintf(stderr, "Could not write %s\n", path);
+      MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    MPI_File_close(&fh);
+    if (count > 0) {
+      MPI_Type_free(&view);
+    }
+}
+
+int main(int argc, char ** argv) {
+
+    matwrite_mode mode = MATWRITE_TEXT;
+    bench_options bench = BENCH_DEFAULTS;
+    distribution dist = DIST_ROWS;
+    int threads = 1; // OpenMP threads per process
+    int verify = 0;  // Freivalds trials, 0 without --verify
+    int opt;
+
+    static const struct option long_options[] = {
+        { "verify", optional_argument, NULL, 'V' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "o:m:t:b:w:k:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'm':
+            for (dist = DIST_ROWS; dist <= DIST_PIPELINE && strcmp(optarg, dist_names[dist]) != 0; dist++);
+            if (dist > DIST_PIPELINE) {
+                argc = 0; // Print the usage
+            }
+            break;
+        case 'o':
+            if (!matwrite_parse_mode(optarg, &mode)) {
+                argc = 0; // Print the usage
+            }
+            break;
+        case 'V':
+            if ((verify = freivalds_parse(optarg)) < 0) {
+                argc = 0; // Print the usage
+            }
+            break;
+        case 't': {
+            char *end;
+            long value = strtol(optarg, &end, 0);
+            if (end == optarg || *end != '\0' || value < 1 || value > INT_MAX) {
+                argc = 0; // Print the usage
+            }
+            threads = (int) value;
+            break;
+        }
+        case 'b':
+            bench.size = (int) strtol(optarg, NULL, 0);
+            break;
+        case 'w':
+            bench.warmups = (int) strtol(optarg, NULL, 0);
+            break;
+        case 'k':
+            bench.reps = (int) strtol(optarg, NULL, 0);
+            break;
+        default:
+            argc = 0; // Print the usage
+        }
+    }
+
+    // In benchmark mode the size is given by -b instead of <dimension>
+    int nargs = argc - optind + (bench.size > 0);
+    if ((nargs != 1 && nargs != 2) || (bench.size > 0 && nargs != 1)
+        || bench.size < 0 || bench.warmups < 0 || bench.reps < 1 || threads < 1) {
+        fprintf(stderr, "Usage: %s [-m rows|summa|pipeline] [-t <threads>] [-o text|binary|sum] [--verify[=<trials>]] <dimension>\n", argv[0]);
+        fprintf(stderr, "       %s [-m rows|summa|pipeline] [-t <threads>] [-o text|binary|sum] [--verify[=<trials>]] <file1> <file2>\n", argv[0]);
+        fprintf(stderr, "       %s [-m rows|summa|pipeline] [-t <threads>] -b <dimension> [-w <warmups>] [-k <reps>]\n", argv[0]);
+        fprintf(stderr, "  -m  rows: rank 0 distributes blocks of rows to the others (default)\n");
+        fprintf(stderr, "      summa: SUMMA on a 2D grid of all ranks\n");
+        fprintf(stderr, "      pipeline: rows sent in panels, overlapping communication and computation\n");
+        fprintf(stderr, "  -o  text: c.txt written by rank 0 (default), sum: only sum and hash,\n");
+        fprintf(stderr, "      binary: c.mat written by all processes with MPI-IO\n");
+        fprintf(stderr, "  -t  OpenMP threads per process (hybrid mode), e.g. one process per socket:\n");
+        fprintf(stderr, "      mpirun -np <sockets> --map-by socket:PE=<cores> %s -t <cores> ...\n", argv[0]);
+        fprintf(stderr, "  --verify  check the result with Freivalds' algorithm (default: %d trials)\n", FREIVALDS_TRIALS);
+        fprintf(stderr, "  -b  benchmark the multiplication of the generated matrices\n");
+        fprintf(stderr, "      (default: 1 warmup, 5 repetitions) and print the timings as CSV\n");
+        return EXIT_FAILURE;
+    }
+
+    // Only the main thread of a process communicates, between the parallel regions
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    int nprocs, rank;
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if (provided < MPI_THREAD_FUNNELED && threads > 1) {
+        if (!rank) {
+            fputs("the MPI library doesn't support threads, using 1 thread per process\n", stderr);
+        }
+        threads = 1;
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#else
+    threads = 1;
+#endif
+
+    bool summa = (dist == DIST_SUMMA);
+    if (nprocs < 2 && !summa) {
+        if (!rank) {
+            fputs("at least 2 processes are needed: the main process only distributes the work\n", stderr);
+        }
+        MPI_Finalize();
+        return EXIT_FAILURE;
+    }
+
+    // Either both matrices are read from binary files or they are generated
+    bool from_file = (nargs == 2);
+    char **args = argv + optind - 1;
+    int dim = 0;
+
+    // Complete matrices: mapped from the files, or generated where a process needs all of them
+    matrix_t A = {0};
+    matrix_t B = {0};
+    matrix_t R = {0};
+
+    if (from_file) {
+        // Every process maps the files, only the pages it reads are loaded
+        if (!read_matrix(args[1], &A) || !read_matrix(args[2], &B)) {
+            fputs("could not read input matrices\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        if (A.dim != B.dim) {
+            fputs("could not multiply: matrices have different dimensions\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        dim = A.dim;
+    } else {
+        dim = bench.size > 0 ? bench.size : (int) strtol(args[1], NULL, 0);
+        A.dim = dim;
+        B.dim = dim;
+    }
+    R.dim = dim;
+
+    // SUMMA: every process only holds its own blocks of A, B and R
+    summa_grid grid;
+    matrix_elem_t *a_local = NULL, *b_local = NULL, *r_local = NULL;
+    if (summa) {
+        summa_create(&grid, MPI_COMM_WORLD, dim);
+        a_local = alloc_elems(grid.r1 - grid.r0, grid.c1 - grid.c0);
+        b_local = alloc_elems(grid.r1 - grid.r0, grid.c1 - grid.c0);
+        r_local = alloc_elems(grid.r1 - grid.r0, grid.c1 - grid.c0);
+        if (from_file) {
+            copy_block(A, grid.r0, grid.r1, grid.c0, grid.c1, a_local);
+            copy_block(B, grid.r0, grid.r1, grid.c0, grid.c1, b_local);
+        } else {
+            initialize_block(a_local, grid.r0, grid.r1, grid.c0, grid.c1);
+            initialize_block(b_local, grid.r0, grid.r1, grid.c0, grid.c1);
+        }
+        // Only rank 0 collects the result, and only if it is written as text or summed up
+        if (!rank && bench.size == 0 && mode != MATWRITE_BINARY) {
+            R.data = alloc_elems(dim, dim);
+        }
+    }
+
+    // Binary output is written by all processes, the others are collected on rank 0
+    bool parallel_output = (bench.size == 0 && mode == MATWRITE_BINARY);
+
+    // Row distribution: the main process holds A and R, the workers their rows of them
+    // (in the pipeline only two panels) and B. With binary output the workers of the
+    // row distribution write their rows of R themselves, so rank 0 doesn't collect R.
+    matrix_t A_rows = {0};
+    matrix_t R_rows = {0};
+    A_rows.dim = R_rows.dim = dim;
+    if (!summa) {
+        if (!rank) {
+            if (!from_file) {
+                A.data = alloc_elems(dim, dim);
+                initialize_block(A.data, 0, dim, 0, dim);
+            }
+            A_rows.data = A.data;
+            if (!(parallel_output && dist == DIST_ROWS)) {
+                R.data = alloc_elems(dim, dim);
+            }
+            R_rows.data = R.data;
+        } else {
+            if (dist == DIST_ROWS) {
+                A_rows.data = alloc_elems(worker_rows(dim, rank, nprocs), dim);
+                R_rows.data = alloc_elems(worker_rows(dim, rank, nprocs), dim);
+            }
+            if (!from_file) {
+                B.data = alloc_elems(dim, dim);
+                initialize_block(B.data, 0, dim, 0, dim);
+            }
+        }
+    }
+
+    // A normal run is timed once, in benchmark mode the kernel is repeated
+    if (bench.size == 0) {
+        bench.warmups = 0;
+        bench.reps = 1;
+    }
+    double start, elapsed, time = 0.0;
+    pipeline_times pipe, pipe_sum = {0, 0, 0};
+    double *times = malloc(bench.reps * sizeof(double));
+    if (times == NULL) {
+        perror("Could not allocate memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = -bench.warmups; i < bench.reps; i++) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        start = MPI_Wtime();
+
+        if (summa) {
+            summa_mult(&grid, a_local, b_local, r_local);
+        } else if (dist == DIST_PIPELINE) {
+            pipeline_mult(A.data, B.data, R.data, dim, rank, nprocs, &pipe);
+            if (i >= 0) {
+                pipe_sum.compute += pipe.compute / bench.reps;
+                pipe_sum.hidden += pipe.hidden / bench.reps;
+                pipe_sum.exposed += pipe.exposed / bench.reps;
+            }
+        } else {
+            matrix_mult(A_rows, B, R_rows, rank, nprocs, !parallel_output);
+        }
+
+        elapsed = MPI_Wtime() - start;
+        MPI_Reduce(&elapsed, &time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (i >= 0 && !rank) {
+            times[i] = time;
+        }
+    }
+
+    // Every process checks the blocks it holds after the multiplication
+    bool verified = true;
+    if (verify > 0 && bench.size == 0) {
+        verify_block a_blk = {0, 0, 0, dim, NULL, dim}, b_blk = a_blk, r_blk = a_blk;
+        if (summa) {
+            verify_block blk = {grid.r0, grid.r1, grid.c0, grid.c1, NULL, grid.c1 - grid.c0};
+            a_blk = b_blk = r_blk = blk;
+            a_blk.data = a_local;
+            b_blk.data = b_local;
+            r_blk.data = r_local;
+        } else if (rank) {
+            // Each worker takes its rows of B, in the row distribution also of A and R
+            b_blk.r0 = (rank - 1) * (dim / (nprocs - 1));
+            b_blk.r1 = b_blk.r0 + worker_rows(dim, rank, nprocs);
+            b_blk.data = &B.data[(size_t) b_blk.r0 * dim];
+            if (dist == DIST_ROWS) {
+                a_blk.r0 = r_blk.r0 = b_blk.r0;
+                a_blk.r1 = r_blk.r1 = b_blk.r1;
+                a_blk.data = A_rows.data;
+                r_blk.data = R_rows.data;
             }
+        } else if (dist == DIST_PIPELINE) {
+            // The pipeline workers don't keep their rows, A and R are only complete on rank 0
+            a_blk.r1 = r_blk.r1 = dim;
+            a_blk.data = A.data;
+            r_blk.data = R.data;
+        }
+        int failed = verify_mult(MPI_COMM_WORLD, dim, a_blk, b_blk, r_blk, verify);
+        verified = (failed == 0);
+        if (!rank) {
+            freivalds_report(verify, failed);
         }
+    }
+
+    double output_time = 0.0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
 
-        MPI_Send(&R.data[(rank - 1) * rows_per_proc * dim], rows_per_proc * dim, MPI_DOUBLE, 0, TAG, MPI_COMM_WORLD);
+    if (summa) {
+        if (parallel_output) {
+            write_blocks("c.mat", dim, grid.r0, grid.r1, grid.c0, grid.c1, r_local);
+        } else if (bench.size == 0) {
+            gather_blocks(&grid, r_local, R);
+        }
+        free(a_local);
+        free(b_local);
+        free(r_local);
+        summa_free(&grid);
+    } else if (parallel_output && dist == DIST_ROWS) {
+        // The workers write the rows they calculated
+        int r0 = rank ? (rank - 1) * (dim / (nprocs - 1)) : 0;
+        int rows = rank ? worker_rows(dim, rank, nprocs) : 0;
+        write_blocks("c.mat", dim, r0, r0 + rows, 0, dim, R_rows.data);
+    } else if (parallel_output) {
+        // The pipeline workers only keep two panels, R is only complete on rank 0
+        write_blocks("c.mat", dim, 0, rank ? 0 : dim, 0, dim, R.data);
+    }
+    if (parallel_output) {
+        elapsed = MPI_Wtime() - start;
+        MPI_Reduce(&elapsed, &output_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
     }
 
-    elapsed = MPI_Wtime() - start;
-    MPI_Reduce( &elapsed, &time, 1, MPI_DOUBLE, MPI_MAX, 0 , MPI_COMM_WORLD);
+    // Average time per multiplication of the workers
+    if (dist == DIST_PIPELINE) {
+        double worker[3] = { pipe_sum.compute, pipe_sum.hidden, pipe_sum.exposed }, total[3];
+        if (!rank) {
+            worker[0] = worker[1] = worker[2] = 0.0;
+        }
+        MPI_Reduce(worker, total, 3, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (!rank) {
+            fprintf(stderr, "Workers: compute %.6f s, communication hidden %.6f s, exposed %.6f s\n",
+                    total[0] / (nprocs - 1), total[1] / (nprocs - 1), total[2] / (nprocs - 1));
+        }
+    }
 
     if (!rank) {
-        fprintf(stderr, "Time used: %14.8f seconds\n", time);
-        print_matrix(R);
+        if (bench.size > 0) {
+            char name[32];
+            snprintf(name, sizeof(name), dist == DIST_ROWS ? "mmul_mpi" : "mmul_mpi_%s", dist_names[dist]);
+            bench_report(name, "double", dim, nprocs * threads, times, bench.reps);
+        } else {
+            fprintf(stderr, "Time used: %14.8f seconds\n", time);
+            if (!parallel_output) {
+                start = MPI_Wtime();
+                print_matrix(R, mode);
+                output_time = MPI_Wtime() - start;
+            }
+            fprintf(stderr, "Output:    %14.8f seconds\n", output_time);
+        }
+    }
+    free(times);
+
+    if (dist == DIST_ROWS && rank) {
+        free(A_rows.data);
+        free(R_rows.data);
     }
+    free_matrix(&A);
+    free_matrix(&B);
+    free_matrix(&R);
 
     MPI_Finalize();
+    return verified ? EXIT_SUCCESS : EXIT_FAILURE;
 }
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "block.h"
+
+#ifdef _OPENMP
+  #include <omp.h>
+#endif
+#include "pipeline.h"
+
+// Rows and columns of a panel multiplied between two polls of the pending messages
+#define POLL_ROWS 4
+#define POLL_COLS 128
+
+typedef struct {
+    MPI_Request req;
+    double posted;      // MPI_Wtime when the message was posted
+} message;
+
+/* First row and number of rows of worker w, as in the row distribution */
+static void worker_slab(int n, int nprocs, int w, int *first, int *rows)
+{
+    int per_proc = n / (nprocs - 1);
+
+    *first = (w - 1) * per_proc;
+    *rows = per_proc + (w == nprocs - 1 ? n % (nprocs - 1) : 0);
+}
+
+/* Check if a message is done, its whole time in flight was hidden */
+static void poll(message *m, pipeline_times *times)
+{
+    int done;
+
+    if (m->req != MPI_REQUEST_NULL) {
+        MPI_Test(&m->req, &done, MPI_STATUS_IGNORE);
+        if (done) {
+            times->hidden += MPI_Wtime() - m->posted;
+        }
+    }
+}
+
+/* Wait for a message, the waiting is exposed */
+static void finish(message *m, pipeline_times *times)
+{
+    double start;
+
+    if (m->req != MPI_REQUEST_NULL) {
+        start = MPI_Wtime();
+        MPI_Wait(&m->req, MPI_STATUS_IGNORE);
+        times->hidden += start - m->posted;
+        times->exposed += MPI_Wtime() - start;
+    }
+}
+
+static void distribute(const double *a, double *r, int n, int nprocs, pipeline_times *times)
+{
+    int w, p, first, rows, count = 0, panels = 0;
+
+    for (w = 1; w < nprocs; w++) {
+        worker_slab(n, nprocs, w, &first, &rows);
+        panels += (rows + PIPELINE_ROWS - 1) / PIPELINE_ROWS;
+    }
+    MPI_Request *sends = malloc((panels + 1) * sizeof(MPI_Request));
+    MPI_Request *recvs = malloc((panels + 1) * sizeof(MPI_Request));
+    if (sends == NULL || recvs == NULL) {
+        perror("Could not allocate memory.");
+        exit(EXIT_FAILURE);
+    }
+
+    // Everything is posted at once, the tag is the number of the panel
+    for (w = 1; w < nprocs; w++) {
+        worker_slab(n, nprocs, w, &first, &rows);
+        for (p = 0; p * PIPELINE_ROWS < rows; p++, count++) {
+            int i = first + p * PIPELINE_ROWS;
+            int size = ((rows - p * PIPELINE_ROWS < PIPELINE_ROWS) ? rows - p * PIPELINE_ROWS : PIPELINE_ROWS) * n;
+            MPI_Isend(&a[(size_t) i * n], size, MPI_DOUBLE, w, p, MPI_COMM_WORLD, &sends[count]);
+            MPI_Irecv(&r[(size_t) i * n], size, MPI_DOUBLE, w, p, MPI_COMM_WORLD, &recvs[count]);
+        }
+    }
+
+    // The results are taken in the order they come in
+    double start = MPI_Wtime();
+    for (p = 0; p < panels; p++) {
+        MPI_Waitany(panels, recvs, &w, MPI_STATUS_IGNORE);
+    }
+    MPI_Waitall(panels, sends, MPI_STATUSES_IGNORE);
+    times->exposed += MPI_Wtime() - start;
+
+    free(sends);
+    free(recvs);
+}
+
+static void work(const double *b, int n, int rank, int nprocs, pipeline_times *times)
+{
+    int first, rows, panels, p, cur, i, j, h;
+    message recv[2] = {{MPI_REQUEST_NULL, 0}, {MPI_REQUEST_NULL, 0}};
+    message send[2] = {{MPI_REQUEST_NULL, 0}, {MPI_REQUEST_NULL, 0}};
+    double *a_buf[2], *r_buf[2];
+
+    worker_slab(n, nprocs, rank, &first, &rows);
+    panels = (rows + PIPELINE_ROWS - 1) / PIPELINE_ROWS;
+    for (cur = 0; cur < 2; cur++) {
+        a_buf[cur] = malloc(((size_t) PIPELINE_ROWS * n + 1) * sizeof(double));
+        r_buf[cur] = malloc(((size_t) PIPELINE_ROWS * n + 1) * sizeof(double));
+        if (a_buf[cur] == NULL || r_buf[cur] == NULL) {
+            perror("Could not allocate memory.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // The first two panels are requested right away
+    for (p = 0; p < 2 && p < panels; p++) {
+        recv[p].posted = MPI_Wtime();
+        MPI_Irecv(a_buf[p], PIPELINE_ROWS * n, MPI_DOUBLE, 0, p, MPI_COMM_WORLD, &recv[p].req);
+    }
+
+    for (p = 0; p < panels; p++) {
+        cur = p % 2;
+        h = (rows - p * PIPELINE_ROWS < PIPELINE_ROWS) ? rows - p * PIPELINE_ROWS : PIPELINE_ROWS;
+
+        // Panel p has to be there and the result of panel p - 2 gone
+        finish(&recv[cur], times);
+        finish(&send[cur], times);
+
+        double start = MPI_Wtime();
+        memset(r_buf[cur], 0, (size_t) h * n * sizeof(double));
+        /* The panel is split into POLL_ROWS x POLL_COLS pieces shared by the
+         * threads (block_mult runs single-threaded inside the parallel loop).
+         * Only the main thread may call MPI, it polls between its pieces. */
+        #pragma omp parallel for collapse(2) schedule(dynamic, 1) private(j)
+        for (i = 0; i < h; i += POLL_ROWS) {
+            for (j = 0; j < n; j += POLL_COLS) {
+                block_mult((h - i < POLL_ROWS) ? h - i : POLL_ROWS, (n - j < POLL_COLS) ? n - j : POLL_COLS, n,
+                           &a_buf[cur][(size_t) i * n], n, &b[j], n, &r_buf[cur][(size_t) i * n + j], n);
+#ifdef _OPENMP
+                if (omp_get_thread_num() == 0)
+#endif
+                {
+                    // MPI_Test also lets the library progress the messages of the other buffer
+                    poll(&recv[1 - cur], times);
+                    poll(&send[1 - cur], times);
+                }
+            }
+        }
+        times->compute += MPI_Wtime() - start;
+
+        send[cur].posted = MPI_Wtime();
+        MPI_Isend(r_buf[cur], h * n, MPI_DOUBLE, 0, p, MPI_COMM_WORLD, &send[cur].req);
+        if (p + 2 < panels) {
+            recv[cur].posted = MPI_Wtime();
+            MPI_Irecv(a_buf[cur], PIPELINE_ROWS * n, MPI_DOUBLE, 0, p + 2, MPI_COMM_WORLD, &recv[cur].req);
+        }
+    }
+    finish(&send[0], times);
+    finish(&send[1], times);
+
+    for (cur = 0; cur < 2; cur++) {
+        free(a_buf[cur]);
+        free(r_buf[cur]);
+    }
+}
+
+void pipeline_mult(const double *a, const double *b, double *r, int n, int rank, int nprocs,
+                   pipeline_times *times)
+{
+    memset(times, 0, sizeof(*times));
+    if (rank == 0) {
+        distribute(a, r, n, nprocs, times);
+    } else {
+        work(b, n, rank, nprocs, times);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+/* Pipelined row distribution.
+ *
+ * Like the row distribution of mmul_mpi, every worker process calculates a
+ * contiguous block of rows of R, but the rows of A are sent in panels of
+ * PIPELINE_ROWS rows. A worker receives the next panel into a second buffer
+ * (MPI_Irecv) while it multiplies the current one, and sends every panel of
+ * R back (MPI_Isend) as soon as it is finished. The main process posts all
+ * sends and receives at once and takes the results in the order they arrive.
+ *
+ * While multiplying, the worker polls its pending messages with MPI_Test.
+ * The time a message was in flight while the worker did something else
+ * counts as hidden, the time it blocked in MPI_Wait as exposed. */
+
+#define PIPELINE_ROWS 32
+
+typedef struct {
+    double compute;     // Multiplying
+    double hidden;      // Messages in flight while computing
+    double exposed;     // Waiting for messages
+} pipeline_times;
+
+/* R = A * B for nxn matrices on nprocs >= 2 processes. On the main process
+ * (rank 0) a and r hold all of A and R and b is not used, the workers only
+ * need all of B. times is set to the breakdown of this process. */
+void pipeline_mult(const double *a, const double *b, double *r, int n, int rank, int nprocs,
+                   pipeline_times *times);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "block.h"
+#include "summa.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+int summa_split(int n, int parts, int i)
+{
+    return (int) ((long) n * i / parts);
+}
+
+void summa_create(summa_grid *g, MPI_Comm comm, int n)
+{
+    int nprocs, rank, dims[2] = {0, 0}, periods[2] = {0, 0}, coords[2];
+    int keep_cols[2] = {0, 1}, keep_rows[2] = {1, 0};
+
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Dims_create(nprocs, 2, dims);
+
+    // No reordering: rank 0 stays at (0, 0)
+    MPI_Cart_create(comm, 2, dims, periods, 0, &g->grid);
+    MPI_Comm_rank(g->grid, &rank);
+    MPI_Cart_coords(g->grid, rank, 2, coords);
+    MPI_Cart_sub(g->grid, keep_cols, &g->row);
+    MPI_Cart_sub(g->grid, keep_rows, &g->col);
+
+    g->rows = dims[0];
+    g->cols = dims[1];
+    g->my_row = coords[0];
+    g->my_col = coords[1];
+    g->n = n;
+    g->r0 = summa_split(n, g->rows, g->my_row);
+    g->r1 = summa_split(n, g->rows, g->my_row + 1);
+    g->c0 = summa_split(n, g->cols, g->my_col);
+    g->c1 = summa_split(n, g->cols, g->my_col + 1);
+}
+
+void summa_free(summa_grid *g)
+{
+    MPI_Comm_free(&g->row);
+    MPI_Comm_free(&g->col);
+    MPI_Comm_free(&g->grid);
+}
+
+void summa_mult(summa_grid *g, const double *a, const double *b, double *r)
+{
+    int m = g->r1 - g->r0, nc = g->c1 - g->c0;
+    int k, k1, w, i, owner_col = 0, owner_row = 0;
+
+    double *a_panel = malloc(((size_t) m * SUMMA_NB + 1) * sizeof(double));
+    double *b_panel = malloc(((size_t) SUMMA_NB * nc + 1) * sizeof(double));
+    if (a_panel == NULL || b_panel == NULL) {
+        perror("Could not allocate memory.");
+        exit(EXIT_FAILURE);
+    }
+    memset(r, 0, (size_t) m * nc * sizeof(double));
+
+    for (k = 0; k < g->n; k = k1) {
+        // A panel must not cross the blocks of A's columns and of B's rows
+        while (summa_split(g->n, g->cols, owner_col + 1) <= k) {
+            owner_col++;
+        }
+        while (summa_split(g->n, g->rows, owner_row + 1) <= k) {
+            owner_row++;
+        }
+        k1 = MIN(k + SUMMA_NB, summa_split(g->n, g->cols, owner_col + 1));
+        k1 = MIN(k1, summa_split(g->n, g->rows, owner_row + 1));
+        w = k1 - k;
+
+        // Columns [k, k1) of A from the grid column owning them to the whole grid row
+        if (g->my_col == owner_col) {
+            for (i = 0; i < m; ++i) {
+                memcpy(&a_panel[(size_t) i * w], &a[(size_t) i * nc + (k - g->c0)], w * sizeof(double));
+            }
+        }
+        MPI_Bcast(a_panel, m * w, MPI_DOUBLE, owner_col, g->row);
+
+        // Rows [k, k1) of B are contiguous and can be sent in place by their owner
+        double *b_rows = b_panel;
+        if (g->my_row == owner_row) {
+            b_rows = (double *) &b[(size_t) (k - g->r0) * nc];
+        }
+        MPI_Bcast(b_rows, w * nc, MPI_DOUBLE, owner_row, g->col);
+
+        block_mult(m, nc, w, a_panel, w, b_rows, nc, r, nc);
+    }
+
+    free(a_panel);
+    free(b_panel);
+}
@@ -0,0 +1,39 @@
+#ifndef SUMMA_H
+#define SUMMA_H
+
+#include <mpi.h>
+
+/* SUMMA on a 2D grid of processes.
+ *
+ * The n x n matrices A, B and R are split into blocks the same way: the
+ * rows into as many parts as the grid has rows, the columns into as many
+ * parts as it has columns. The process at (row, col) of the grid holds
+ * block (row, col) of each matrix. For every panel of at most SUMMA_NB
+ * columns of A / rows of B, the owners broadcast their part of the panel
+ * along their grid row (A) and grid column (B), and every process adds the
+ * product of the two panels to its block of R. Each process sends and
+ * receives O(n^2 / sqrt(p)) elements. */
+
+#define SUMMA_NB 128
+
+typedef struct {
+    MPI_Comm grid;      // Cartesian communicator of all processes
+    MPI_Comm row, col;  // Processes of the same grid row / column, ranked by column / row
+    int rows, cols;     // Shape of the grid
+    int my_row, my_col; // Coordinates of this process
+    int n;
+    int r0, r1;         // Rows [r0, r1) of the blocks of this process
+    int c0, c1;         // Columns [c0, c1) of the blocks of this process
+} summa_grid;
+
+/* First index of part i of n elements split into parts parts */
+int summa_split(int n, int parts, int i);
+
+/* Arrange the processes of comm in a grid as square as possible (MPI_Dims_create) */
+void summa_create(summa_grid *g, MPI_Comm comm, int n);
+void summa_free(summa_grid *g);
+
+/* R = A * B. a, b and r are the (r1 - r0) x (c1 - c0) local blocks, row major */
+void summa_mult(summa_grid *g, const double *a, const double *b, double *r);
+
+#endif /* SUMMA_H */
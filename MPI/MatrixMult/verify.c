@@ -0,0 +1,76 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freivalds.h"
+#include "verify.h"
+
+/* dst[i] += sign * M x and abs_dst[i] += |M| |x| for the rows of block m,
+ * with x indexed by the columns of the whole matrix */
+static void add_product(verify_block m, const double *x, const double *abs_x, double sign,
+                        double *dst, double *abs_dst)
+{
+    int i;
+
+    #pragma omp parallel for schedule(static)
+    for (i = m.r0; i < m.r1; i++) {
+        const double *mi = &m.data[(size_t) (i - m.r0) * m.ld];
+        double sum = 0.0, abs_sum = 0.0;
+        for (int j = m.c0; j < m.c1; j++) {
+            sum += mi[j - m.c0] * x[j];
+            abs_sum += fabs(mi[j - m.c0]) * abs_x[j];
+        }
+        dst[i] += sign * sum;
+        abs_dst[i] += abs_sum;
+    }
+}
+
+int verify_mult(MPI_Comm comm, int n, verify_block a, verify_block b, verify_block r, int trials)
+{
+    int rank, trial, i, failed = 0;
+    uint64_t seed = freivalds_seed();
+
+    // Vectors of length n: x, y = B x, |B| x, A y - R x, |A| |B| x + |R| x
+    double *buf = malloc(5 * (size_t) n * sizeof(double) + 1);
+    double *x = buf, *y = x + n, *y_abs = y + n, *z = y_abs + n, *z_abs = z + n;
+    if (buf == NULL) {
+      perror("Could not allocate memory.");
+      exit(EXIT_FAILURE);
+    }
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Bcast(&seed, 1, MPI_UINT64_T, 0, comm);
+    if (b.data == NULL) {
+      b.r1 = b.r0;
+    }
+    if (a.data == NULL || r.data == NULL) {
+      a.r1 = a.r0;
+      r.r1 = r.r0;
+    }
+
+    for (trial = 0; trial < trials; trial++) {
+      for (i = 0; i < n; i++) {
+        x[i] = freivalds_x(seed, trial, i);
+      }
+
+      memset(y, 0, 4 * (size_t) n * sizeof(double));
+      add_product(b, x, x, 1.0, y, y_abs);
+      MPI_Allreduce(MPI_IN_PLACE, y, 2 * n, MPI_DOUBLE, MPI_SUM, comm);
+
+      add_product(a, y, y_abs, 1.0, z, z_abs);
+      add_product(r, x, x, -1.0, z, z_abs);
+      MPI_Reduce(rank ? z : MPI_IN_PLACE, z, 2 * n, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+      if (!rank) {
+        // Written so that NaN fails too
+        for (i = 0; i < n && fabs(z[i]) <= freivalds_tolerance(n, z_abs[i]); i++) {
+        }
+        failed += (i < n);
+      }
+    }
+
+    MPI_Bcast(&failed, 1, MPI_INT, 0, comm);
+    free(buf);
+    return failed;
+}
@@ -0,0 +1,27 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <mpi.h>
+#include <stddef.h>
+
+/* Distributed Freivalds check of R = A * B (see freivalds.h).
+ *
+ * Every process passes the blocks of A, B and R it holds after the
+ * multiplication, whatever the distribution. For each trial the processes
+ * add the contributions of their blocks of B to y = B * x (MPI_Allreduce)
+ * and those of their blocks of A and R to A * y - R * x (MPI_Reduce to
+ * rank 0), so each one only multiplies its own elements. The blocks of A
+ * and R of a process cover the same rows. */
+
+typedef struct {
+    int r0, r1;         // Rows [r0, r1) of the matrix
+    int c0, c1;         // Columns [c0, c1)
+    const double *data; // Row major, NULL (or r0 == r1) if the process holds nothing
+    size_t ld;
+} verify_block;
+
+/* Check the nxn product with the given number of trials. Returns the
+ * number of failed trials on all processes. */
+int verify_mult(MPI_Comm comm, int n, verify_block a, verify_block b, verify_block r, int trials);
+
+#endif /* VERIFY_H */
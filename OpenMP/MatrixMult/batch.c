@@ -0,0 +1,308 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "batch.h"
+#include "kernel.h"
+
+/* Same as in kernel.c: the best instruction set is chosen when the program is loaded */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+  #define BATCH_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+  #define BATCH_CLONES
+#endif
+
+/* C = A * B for N x N matrices. The size is known at compile time, so the loop
+ * over a row of B has no remainder and is unrolled (completely up to N = 16,
+ * unrolling 32 or 64 iterations was slower) and a row of C stays in registers. */
+#define SMALL_KERNEL(N)                                                         \
+BATCH_CLONES                                                                    \
+static void small_mult_##N(const uint64_t *a, const uint64_t *b, uint64_t *c)  \
+{                                                                               \
+    int i, j, x;                                                                \
+                                                                                \
+    for (i = 0; i < N; ++i) {                                                   \
+        uint64_t ci[N] = { 0 };                                                 \
+        for (x = 0; x < N; ++x) {                                               \
+            uint64_t aix = a[i * N + x];                                        \
+            _Pragma("GCC unroll 16")                                            \
+            for (j = 0; j < N; ++j) {                                           \
+                ci[j] += aix * b[x * N + j];                                    \
+            }                                                                   \
+        }                                                                       \
+        memcpy(&c[i * N], ci, sizeof(ci));                                      \
+    }                                                                           \
+}
+
+SMALL_KERNEL(4)
+SMALL_KERNEL(8)
+SMALL_KERNEL(16)
+SMALL_KERNEL(32)
+SMALL_KERNEL(64)
+
+/* Read all of fd into a newly allocated, zero terminated buffer */
+static char *read_all(int fd, size_t *len)
+{
+    size_t cap = 1 << 20;
+    ssize_t got;
+    char *buf = malloc(cap);
+
+    *len = 0;
+    while (buf != NULL) {
+        if (cap - *len < 2) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+            if (buf == NULL) {
+                break;
+            }
+        }
+        got = read(fd, buf + *len, cap - *len - 1);
+        if (got < 0) {
+            free(buf);
+            return NULL;
+        }
+        if (got == 0) {
+            buf[*len] = '\0';
+            return buf;
+        }
+        *len += got;
+    }
+    perror("Could not allocate memory for the batch!");
+    exit(EXIT_FAILURE);
+}
+
+/* Parse the next integer after *p, false at the end of the text */
+static bool next_int(char **p, int64_t *value)
+{
+    char *end;
+
+    while (**p == ' ' || **p == '\t' || **p == '\n' || **p == '\r') {
+        ++*p;
+    }
+    if (**p == '\0') {
+        return false;
+    }
+    *value = strtoll(*p, &end, 10);
+    if (end == *p) {
+        return false;
+    }
+    *p = end;
+    return true;
+}
+
+/* Append the next matrix of the text to the elements, returns its dimensions */
+static bool next_matrix(char **p, batch_t *batch, size_t *used, size_t *cap, int *rows, int *cols)
+{
+    int64_t r, c, i, n;
+
+    if (!next_int(p, &r) || !next_int(p, &c) || r < 1 || c < 1 || r > INT32_MAX || c > INT32_MAX) {
+        return false;
+    }
+    n = r * c;
+    while (*cap - *used < (size_t) n) {
+        *cap *= 2;
+        batch->elems = realloc(batch->elems, *cap * sizeof(int64_t));
+        if (batch->elems == NULL) {
+            perror("Could not allocate memory for the batch!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (i = 0; i < n; ++i) {
+        if (!next_int(p, &batch->elems[*used + i])) {
+            return false;
+        }
+    }
+    *used += n;
+    *rows = (int) r;
+    *cols = (int) c;
+    return true;
+}
+
+bool batch_read(const char *path, batch_t *batch)
+{
+    size_t len, used = 0, cap = 1 << 16, pairs = 256, results = 0;
+    int fd = STDIN_FILENO, ra, ca, rb, cb;
+    char *text, *p;
+
+    memset(batch, 0, sizeof(*batch));
+    if (strcmp(path, "-") != 0 && (fd = open(path, O_RDONLY)) < 0) {
+        perror(path);
+        return false;
+    }
+    text = read_all(fd, &len);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    if (text == NULL) {
+        perror(path);
+        return false;
+    }
+
+    batch->elems = malloc(cap * sizeof(int64_t));
+    batch->dims = malloc(3 * pairs * sizeof(int));
+    batch->a = malloc(pairs * sizeof(size_t));
+    batch->b = malloc(pairs * sizeof(size_t));
+    batch->r = malloc(pairs * sizeof(size_t));
+
+    for (p = text; ; ++batch->count) {
+        if (batch->count == pairs) {
+            pairs *= 2;
+            batch->dims = realloc(batch->dims, 3 * pairs * sizeof(int));
+            batch->a = realloc(batch->a, pairs * sizeof(size_t));
+            batch->b = realloc(batch->b, pairs * sizeof(size_t));
+            batch->r = realloc(batch->r, pairs * sizeof(size_t));
+        }
+        if (batch->elems == NULL || batch->dims == NULL || batch->a == NULL || batch->b == NULL || batch->r == NULL) {
+            perror("Could not allocate memory for the batch!");
+            exit(EXIT_FAILURE);
+        }
+
+        batch->a[batch->count] = used;
+        if (!next_matrix(&p, batch, &used, &cap, &ra, &ca)) {
+            break;
+        }
+        batch->b[batch->count] = used;
+        if (!next_matrix(&p, batch, &used, &cap, &rb, &cb) || ca != rb) {
+            fprintf(stderr, "%s: product %zu is incomplete or its dimensions don't match\n", path, batch->count);
+            free(text);
+            batch_free(batch);
+            return false;
+        }
+        batch->dims[3 * batch->count] = ra;
+        batch->dims[3 * batch->count + 1] = ca;
+        batch->dims[3 * batch->count + 2] = cb;
+        batch->r[batch->count] = results;
+        results += (size_t) ra * cb;
+    }
+
+    // Anything but whitespace after the last complete pair is an error
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+        ++p;
+    }
+    if (*p != '\0') {
+        fprintf(stderr, "%s: invalid matrix after product %zu\n", path, batch->count);
+        free(text);
+        batch_free(batch);
+        return false;
+    }
+    free(text);
+
+    batch->results = malloc(results * sizeof(int64_t) + 1);
+    if (batch->results == NULL) {
+        perror("Could not allocate memory for the batch!");
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
+
+void batch_mult(batch_t *batch)
+{
+    long p;
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (p = 0; p < (long) batch->count; ++p) {
+        int m = batch->dims[3 * p], k = batch->dims[3 * p + 1], n = batch->dims[3 * p + 2];
+        const uint64_t *a = (const uint64_t *) &batch->elems[batch->a[p]];
+        const uint64_t *b = (const uint64_t *) &batch->elems[batch->b[p]];
+        uint64_t *r = (uint64_t *) &batch->results[batch->r[p]];
+
+        if (m != k || k != n) {
+            kernel_mult(m, n, k, a, k, b, n, r, n, false);
+            continue;
+        }
+        switch (n) {
+        case 4:
+            small_mult_4(a, b, r);
+            break;
+        case 8:
+            small_mult_8(a, b, r);
+            break;
+        case 16:
+            small_mult_16(a, b, r);
+            break;
+        case 32:
+            small_mult_32(a, b, r);
+            break;
+        case 64:
+            small_mult_64(a, b, r);
+            break;
+        default:
+            kernel_mult(m, n, k, a, k, b, n, r, n, false);
+        }
+    }
+}
+
+bool batch_print(const batch_t *batch, matwrite_mode mode, int fd)
+{
+    size_t total = 0, p;
+    char line[64];
+    bool ok = true;
+
+    if (batch->count > 0) {
+        total = batch->r[batch->count - 1] + (size_t) batch->dims[3 * batch->count - 3] * batch->dims[3 * batch->count - 1];
+    }
+
+    if (mode == MATWRITE_SUM) {
+        uint64_t sum = 0;
+        for (p = 0; p < total; ++p) {
+            sum += (uint64_t) batch->results[p];
+        }
+        snprintf(line, sizeof(line), "sum: %lld\nhash: %016llx\n", (long long) sum,
+                 (unsigned long long) matwrite_hash(batch->results, total));
+        return matwrite_str(fd, line);
+    }
+
+    // Every result is formatted into its own buffer in parallel, then they are written in order
+    char **text = calloc(batch->count + 1, sizeof(char *));
+    size_t *len = calloc(batch->count + 1, sizeof(size_t));
+    if (text == NULL || len == NULL) {
+        perror("Could not allocate memory for output!");
+        exit(EXIT_FAILURE);
+    }
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (long q = 0; q < (long) batch->count; ++q) {
+        int rows = batch->dims[3 * q], cols = batch->dims[3 * q + 2], i, j;
+        const int64_t *r = &batch->results[batch->r[q]];
+        char *t = malloc((size_t) rows * cols * (MATWRITE_MAX_INT + 2) + rows + 2 * MATWRITE_MAX_INT + 2);
+        size_t l = 0;
+        if (t == NULL) {
+            perror("Could not allocate memory for output!");
+            exit(EXIT_FAILURE);
+        }
+        l += matwrite_format_int(t + l, rows);
+        t[l++] = '\n';
+        l += matwrite_format_int(t + l, cols);
+        t[l++] = '\n';
+        for (i = 0; i < rows; ++i) {
+            for (j = 0; j < cols; ++j) {
+                l += matwrite_format_int(t + l, r[(size_t) i * cols + j]);
+                t[l++] = '\t';
+                t[l++] = ' ';
+            }
+            t[l++] = '\n';
+        }
+        text[q] = t;
+        len[q] = l;
+    }
+
+    for (p = 0; p < batch->count; ++p) {
+        ok = ok && matwrite_all(fd, text[p], len[p]);
+        free(text[p]);
+    }
+    free(text);
+    free(len);
+    return ok;
+}
+
+void batch_free(batch_t *batch)
+{
+    free(batch->dims);
+    free(batch->a);
+    free(batch->b);
+    free(batch->r);
+    free(batch->elems);
+    free(batch->results);
+    memset(batch, 0, sizeof(*batch));
+}
@@ -0,0 +1,42 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "matwrite.h"
+
+/* Batched multiplication of many small matrices (mmul_omp -m).
+ *
+ * The input is one stream of text matrices in the usual format (rows,
+ * columns, elements), read as pairs A1 B1 A2 B2 ... up to its end. The
+ * whole stream is parsed at once and the products are calculated inside a
+ * single parallel region, one product per iteration, so threads pay off
+ * even if every product is tiny. Square products of the sizes 4, 8, 16, 32
+ * and 64 use kernels specialized for their size with unrolled inner loops
+ * and no remainder handling, all others the blocked kernel. The arithmetic wraps around modulo
+ * 2^64 like the other int64 multiplications. */
+
+typedef struct {
+    size_t count;           // Number of products
+    int *dims;              // m, k, n of every product
+    size_t *a, *b, *r;      // Offset of every operand and result in elems / results
+    int64_t *elems;         // All operands
+    int64_t *results;       // All results, one after the other
+} batch_t;
+
+/* Read the pairs from path ("-" for stdin). Returns false and prints a message
+ * if the stream can't be read, holds an odd number of matrices or operands
+ * whose dimensions don't match. */
+bool batch_read(const char *path, batch_t *batch);
+
+/* Calculate all products with the OpenMP threads */
+void batch_mult(batch_t *batch);
+
+/* Write the results as a stream of text matrices in the input format, or
+ * only their sum and hash (MATWRITE_SUM) */
+bool batch_print(const batch_t *batch, matwrite_mode mode, int fd);
+
+void batch_free(batch_t *batch);
+
+#endif /* BATCH_H */
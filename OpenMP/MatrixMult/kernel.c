@@ -0,0 +1,58 @@
+#include <string.h>
+#include "kernel.h"
+#include "matfile.h"
+
+/* Every kernel is compiled for several instruction sets, the best one the CPU
+ * supports is chosen once when the program is loaded. */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+  #define KERNEL_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+  #define KERNEL_CLONES
+#endif
+
+#define KERNEL_NAME kernel_mult
+#define KERNEL_T kernel_elem_t
+#define KERNEL_ROWS 2
+#define KERNEL_TKB KERNEL_KB
+#define KERNEL_TJB KERNEL_JB
+#include "kernel_tmpl.h"
+
+#define KERNEL_NAME kernel_mult_i32
+#define KERNEL_T uint32_t
+#define KERNEL_ROWS 4
+#define KERNEL_TKB 128
+#define KERNEL_TJB 1024
+#include "kernel_tmpl.h"
+
+#define KERNEL_NAME kernel_mult_f32
+#define KERNEL_T float
+#define KERNEL_ROWS 4
+#define KERNEL_TKB 128
+#define KERNEL_TJB 1024
+#include "kernel_tmpl.h"
+
+#define KERNEL_NAME kernel_mult_f64
+#define KERNEL_T double
+#define KERNEL_ROWS 4
+#define KERNEL_TKB 128
+#define KERNEL_TJB 512
+#include "kernel_tmpl.h"
+
+void kernel_mult_type(uint32_t type, int m, int n, int k,
+                      const void *a, size_t lda, const void *b, size_t ldb,
+                      void *c, size_t ldc, bool add)
+{
+    switch (type) {
+    case MATFILE_INT32:
+        kernel_mult_i32(m, n, k, a, lda, b, ldb, c, ldc, add);
+        break;
+    case MATFILE_FLOAT:
+        kernel_mult_f32(m, n, k, a, lda, b, ldb, c, ldc, add);
+        break;
+    case MATFILE_DOUBLE:
+        kernel_mult_f64(m, n, k, a, lda, b, ldb, c, ldc, add);
+        break;
+    default:
+        kernel_mult(m, n, k, a, lda, b, ldb, c, ldc, add);
+    }
+}
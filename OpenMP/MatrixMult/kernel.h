@@ -0,0 +1,46 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Blocked classical multiplication of submatrices, single threaded.
+ * Used as base case of the recursive algorithms.
+ *
+ * The elements are unsigned: additions and multiplications wrap around
+ * like two's complement int64 arithmetic would, but without undefined
+ * behaviour. Intermediate results of e.g. Strassen may overflow even if
+ * the final result doesn't, which still gives the exact result. int64_t
+ * matrices are passed by casting the pointers. */
+typedef uint64_t kernel_elem_t;
+
+/* Blocking: a KERNEL_KB x KERNEL_JB block of B stays in L2 while the rows
+ * of A are multiplied with it. */
+#define KERNEL_KB 128
+#define KERNEL_JB 512
+
+/* C = A * B (or C += A * B if add is true) for the m x k matrix A and the
+ * k x n matrix B. All matrices are row major with the given leading dimensions. */
+void kernel_mult(int m, int n, int k,
+                 const kernel_elem_t *a, size_t lda,
+                 const kernel_elem_t *b, size_t ldb,
+                 kernel_elem_t *c, size_t ldc, bool add);
+
+/* The same kernel for the other element types (mmul_omp -e), generated from
+ * kernel_tmpl.h with block sizes and row counts of their own. int32 wraps
+ * around like kernel_elem_t. */
+void kernel_mult_i32(int m, int n, int k, const uint32_t *a, size_t lda,
+                     const uint32_t *b, size_t ldb, uint32_t *c, size_t ldc, bool add);
+void kernel_mult_f32(int m, int n, int k, const float *a, size_t lda,
+                     const float *b, size_t ldb, float *c, size_t ldc, bool add);
+void kernel_mult_f64(int m, int n, int k, const double *a, size_t lda,
+                     const double *b, size_t ldb, double *c, size_t ldc, bool add);
+
+/* The kernel for elements of the given type (MATFILE_INT32, MATFILE_INT64,
+ * MATFILE_FLOAT or MATFILE_DOUBLE, see matfile.h), selected once per call */
+void kernel_mult_type(uint32_t type, int m, int n, int k,
+                      const void *a, size_t lda, const void *b, size_t ldb,
+                      void *c, size_t ldc, bool add);
+
+#endif /* KERNEL_H */
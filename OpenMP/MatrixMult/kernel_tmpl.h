@@ -0,0 +1,66 @@
+/* Template of the blocked kernel, included by kernel.c once per element type.
+ * Parameters:
+ *   KERNEL_NAME   name of the generated function
+ *   KERNEL_T      element type
+ *   KERNEL_ROWS   rows of C calculated together, they share the loads of B
+ *   KERNEL_TKB    rows of a block of B
+ *   KERNEL_TJB    columns of a block of B
+ * The parameters are undefined again at the end. */
+
+KERNEL_CLONES
+void KERNEL_NAME(int m, int n, int k,
+                 const KERNEL_T *a, size_t lda,
+                 const KERNEL_T *b, size_t ldb,
+                 KERNEL_T *c, size_t ldc, bool add)
+{
+    int i, j, x, r, k0, k1, j0, j1;
+
+    if (!add) {
+        for (i = 0; i < m; ++i) {
+            memset(&c[i * ldc], 0, n * sizeof(KERNEL_T));
+        }
+    }
+
+    for (k0 = 0; k0 < k; k0 = k1) {
+        k1 = (k - k0 > KERNEL_TKB) ? k0 + KERNEL_TKB : k;
+        for (j0 = 0; j0 < n; j0 = j1) {
+            j1 = (n - j0 > KERNEL_TJB) ? j0 + KERNEL_TJB : n;
+
+            // KERNEL_ROWS rows of C at a time, the loop over them is unrolled and the one over j vectorized
+            for (i = 0; i + KERNEL_ROWS <= m; i += KERNEL_ROWS) {
+                KERNEL_T *ci[KERNEL_ROWS];
+                for (r = 0; r < KERNEL_ROWS; ++r) {
+                    ci[r] = &c[(i + r) * ldc];
+                }
+                for (x = k0; x < k1; ++x) {
+                    const KERNEL_T *bx = &b[x * ldb];
+                    KERNEL_T ax[KERNEL_ROWS];
+                    for (r = 0; r < KERNEL_ROWS; ++r) {
+                        ax[r] = a[(i + r) * lda + x];
+                    }
+                    for (j = j0; j < j1; ++j) {
+                        for (r = 0; r < KERNEL_ROWS; ++r) {
+                            ci[r][j] += ax[r] * bx[j];
+                        }
+                    }
+                }
+            }
+            for (; i < m; ++i) {
+                KERNEL_T *c0 = &c[i * ldc];
+                for (x = k0; x < k1; ++x) {
+                    const KERNEL_T *bx = &b[x * ldb];
+                    KERNEL_T a0 = a[i * lda + x];
+                    for (j = j0; j < j1; ++j) {
+                        c0[j] += a0 * bx[j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+#undef KERNEL_NAME
+#undef KERNEL_T
+#undef KERNEL_ROWS
+#undef KERNEL_TKB
+#undef KERNEL_TJB
@@ -1,9 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <errno.h>
+#include <getopt.h>
 #include <time.h>
+#include "affinity.h"
+#include "bench.h"
+#include "csr.h"
+#include "freivalds.h"
+#include "matfile.h"
+#include "matwrite.h"
+#include "textload.h"
+#include "recursive.h"
+#include "strassen.h"
+#include "typed.h"
+#include "batch.h"
+#include "ooc.h"
 
 #ifdef _OPENMP
   #include <omp.h>
@@ -15,53 +31,135 @@ typedef int64_t matrix_elem_t;
 typedef struct {
     int rows, cols;
     matrix_elem_t *data;
+    matfile_t file;     // Mapped binary file if data points into it
+    csr_matrix *sparse; // The elements in CSR form instead of data, see sparsify_matrix
 } matrix_t;
 
 
-bool read_matrix(char *filepath, matrix_t* matrix)
+/* Map a binary matrix (see matfile.h). Row major int64 elements are used in place,
+ * anything else is converted into a newly allocated matrix. */
+bool read_binary_matrix(char *filepath, matrix_t* matrix)
 {
-    int i, j, x;
-    FILE *fp;
-    if ((fp = fopen(filepath, "r")) == NULL) {
-        perror("Can't open file!");
-        exit(EXIT_SUCCESS);
+    if (!matfile_open(filepath, &matrix->file)) {
+        return false;
     }
 
-    fscanf(fp, "%d", &matrix->rows);
-    fscanf(fp, "%d", &matrix->cols);
+    matrix->rows = (int) matrix->file.hdr.rows;
+    matrix->cols = (int) matrix->file.hdr.cols;
 
-    matrix->data = calloc(matrix->rows * matrix->cols, sizeof(matrix_elem_t));
-    if (matrix->data == NULL) {
-        return false;
+    if (matfile_matches(&matrix->file, MATFILE_INT64, false)) {
+        matrix->data = matrix->file.data;
+        return true;
     }
 
-    for (i = 0; i < matrix->rows; ++i) {
-        for (j = 0; j < matrix->cols; ++j) {
-            fscanf(fp, "%d\t", &x);
-            matrix->data[(matrix->cols * i) + j] = x;
-        }
-        fscanf(fp, "\n");
+    matrix->data = malloc((size_t) matrix->rows * matrix->cols * sizeof(matrix_elem_t));
+    if (matrix->data != NULL) {
+        matfile_load_block(&matrix->file, MATFILE_INT64, false, 0, matrix->rows, 0, matrix->cols,
+                           matrix->data, matrix->cols);
     }
+    matfile_close(&matrix->file);
+    return matrix->data != NULL;
+}
 
-    fclose(fp);
 
-    return true;
+void free_matrix(matrix_t* matrix)
+{
+    if (matrix->file.map != NULL) {
+        matfile_close(&matrix->file);
+    } else {
+        free(matrix->data);
+    }
+    matrix->data = NULL;
+    if (matrix->sparse != NULL) {
+        csr_free(matrix->sparse);
+        free(matrix->sparse);
+        matrix->sparse = NULL;
+    }
+}
+
+
+/* Store the elements in CSR form if fewer than CSR_DENSITY of them are nonzero
+ * (see csr.h). The dense elements are freed, but only after both forms were held. */
+void sparsify_matrix(matrix_t* matrix)
+{
+    size_t nnz = csr_count(matrix->data, (size_t) matrix->rows * matrix->cols);
+    if (!csr_is_sparse(nnz, matrix->rows, matrix->cols)) {
+        return;
+    }
+
+    csr_matrix* sparse = malloc(sizeof(csr_matrix));
+    if (sparse == NULL || !csr_from_dense(sparse, matrix->data, matrix->rows, matrix->cols, false, nnz)) {
+        perror("Could not allocate memory for matrix!");
+        exit(EXIT_FAILURE);
+    }
+    free_matrix(matrix);
+    matrix->sparse = sparse;
 }
 
 
-void print_matrix(matrix_t m){
-    int i, j;
+/* Convert a sparse matrix back to dense elements */
+void densify_matrix(matrix_t* matrix)
+{
+    matrix->data = malloc((size_t) matrix->rows * matrix->cols * sizeof(matrix_elem_t));
+    if (matrix->data == NULL) {
+        perror("Could not allocate memory for matrix!");
+        exit(EXIT_FAILURE);
+    }
+    csr_to_dense(matrix->sparse, matrix->data, false);
+    csr_free(matrix->sparse);
+    free(matrix->sparse);
+    matrix->sparse = NULL;
+}
+
+
+/* Read a binary or text matrix. Text files are parsed by t threads (see textload.h).
+ * Sparse matrices are converted to CSR. */
+bool read_matrix(char *filepath, matrix_t* matrix, int t)
+{
+    bool ok;
+
+    if (matfile_is_binary(filepath)) {
+        ok = read_binary_matrix(filepath, matrix);
+    } else {
+        ok = textload_matrix(filepath, false, t, &matrix->rows, &matrix->cols, &matrix->data);
+    }
+
+    if (ok) {
+        sparsify_matrix(matrix);
+    }
+    return ok;
+}
+
+
+/**
+* Write the result to fd: all elements followed by their sum (MATWRITE_TEXT),
+* a binary matrix (MATWRITE_BINARY) or only the sum and a hash (MATWRITE_SUM).
+* Text is formatted by t threads.
+*/
+bool print_matrix(matrix_t m, matwrite_mode mode, int fd, int t){
+    size_t i;
     matrix_elem_t sum;
+    char line[64];
+
+    if (mode == MATWRITE_BINARY) {
+        return matwrite_binary(fd, MATFILE_INT64, m.data, m.rows, m.cols);
+    }
 
     sum = 0;
-    for (i = 0; i < m.rows; ++i) {
-        for (j = 0; j < m.cols; ++j) {
-            sum += m.data[(i * m.cols) + j];
-            printf("%lld\t ", m.data[(i * m.cols) + j]);
-        }
-        printf("\n");
+    for (i = 0; i < (size_t) m.rows * m.cols; ++i) {
+        sum += m.data[i];
+    }
+
+    if (mode == MATWRITE_TEXT && !matwrite_text_int64(fd, m.data, m.rows, m.cols, t)) {
+        return false;
     }
-    printf("sum: %lld\n", sum);
+
+    snprintf(line, sizeof(line), "sum: %lld\n", (long long) sum);
+    if (mode == MATWRITE_SUM) {
+        snprintf(line + strlen(line), sizeof(line) - strlen(line), "hash: %016llx\n",
+                 (unsigned long long) matwrite_hash(m.data, (size_t) m.rows * m.cols));
+    }
+    return matwrite_str(fd, line);
 }
 
 
@@ -81,6 +179,179 @@ void matrix_mult(matrix_t* a, matrix_t* b, matrix_t* r)
     }
 }
 
+/* NUMA mode, set up in main */
+typedef struct {
+    bool enabled;       // Place A, B and R by first touch of their users
+    int *cpus;          // Affinity map, thread i runs on cpus[i % ncpus]
+    int ncpus;
+    bool replicate;     // One copy of B per NUMA node
+} numa_options;
+
+static numa_options numa = { false, NULL, 0, false };
+
+// Strassen-Winograd mode if > 0: below this size the classical kernel is used
+static int strassen_cutoff = 0;
+
+// Cache oblivious recursive multiplication
+static bool recursive = false;
+
+
+// CPUs of the master thread before pin_threads
+static affinity_mask *master_mask = NULL;
+
+/* Pin every OpenMP thread to its CPU of the affinity map for a multiplication.
+ * The threads are reused by all following parallel regions with the same
+ * number of threads. The master's own CPUs are saved, so unpin_master can
+ * restore them before it starts the threads of the I/O, which would
+ * otherwise inherit the single CPU. */
+void pin_threads(void)
+{
+    if (numa.cpus == NULL) {
+        return;
+    }
+    if (master_mask == NULL) {
+        master_mask = affinity_save();
+    }
+    #pragma omp parallel
+    affinity_pin(numa.cpus[omp_get_thread_num() % numa.ncpus]);
+}
+
+void unpin_master(void)
+{
+    if (master_mask != NULL) {
+        affinity_restore(master_mask);
+        master_mask = NULL;
+    }
+}
+
+
+/* Same as matrix_mult, but A, B and R are first copied (R cleared) by the
+ * threads that use them, so their pages are allocated on the NUMA nodes of
+ * those threads. A and R are split by the same static schedule as the
+ * multiplication, B is replicated once per node if numa.replicate is set. */
+void matrix_mult_numa(matrix_t* a, matrix_t* b, matrix_t* r)
+{
+    int t = omp_get_max_threads();
+    int w, v, copies = 0;
+    int *node = calloc(t, sizeof(int));
+    int *copy = calloc(t, sizeof(int));
+
+    if (node == NULL || copy == NULL) {
+        perror("Could not allocate memory!");
+        exit(EXIT_FAILURE);
+    }
+
+    // Threads on the same node share a copy of B
+    for (w = 0; w < t; ++w) {
+        if (numa.replicate) {
+            node[w] = affinity_node_of_cpu(numa.cpus[w % numa.ncpus]);
+        }
+        for (v = 0; v < w && node[v] != node[w]; ++v);
+        copy[w] = (v < w) ? copy[v] : copies++;
+    }
+
+    matrix_elem_t *a_data = malloc((size_t) a->rows * a->cols * sizeof(matrix_elem_t));
+    matrix_elem_t **b_data = calloc(copies, sizeof(matrix_elem_t *));
+    if (a_data == NULL || b_data == NULL) {
+        perror("Could not allocate memory!");
+        exit(EXIT_FAILURE);
+    }
+    for (v = 0; v < copies; ++v) {
+        b_data[v] = malloc((size_t) b->rows * b->cols * sizeof(matrix_elem_t));
+        if (b_data[v] == NULL) {
+            perror("Could not allocate memory!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    #pragma omp parallel
+    {
+        long i, j, k, y;
+        int u, me = omp_get_thread_num();
+        int rank = 0, size = 0;
+
+        #pragma omp for schedule(static)
+        for (i = 0; i < r->rows; ++i) {
+            memcpy(&a_data[i * a->cols], &a->data[i * a->cols], a->cols * sizeof(matrix_elem_t));
+            memset(&r->data[i * r->cols], 0, r->cols * sizeof(matrix_elem_t));
+        }
+
+        // The threads of a copy of B each fill a part of it
+        for (u = 0; u < t; ++u) {
+            if (copy[u] == copy[me]) {
+                rank += (u < me);
+                size++;
+            }
+        }
+        long first = (long) b->rows * rank / size;
+        long last = (long) b->rows * (rank + 1) / size;
+        matrix_elem_t *b_mine = b_data[copy[me]];
+        memcpy(&b_mine[first * b->cols], &b->data[first * b->cols], (last - first) * b->cols * sizeof(matrix_elem_t));
+
+        #pragma omp barrier
+
+        #pragma omp for schedule(static)
+        for (i = 0; i < r->rows; ++i) {
+            for (j = 0; j < r->cols; ++j) {
+                y = 0;
+                for (k = 0; k < a->cols; ++k) {
+                    y += a_data[i * a->cols + k] * b_mine[k * b->cols + j];
+                }
+                r->data[i * r->cols + j] = y;
+            }
+        }
+    }
+
+    for (v = 0; v < copies; ++v) {
+        free(b_data[v]);
+    }
+    free(b_data);
+    free(a_data);
+    free(copy);
+    free(node);
+}
+
+/* Strassen-Winograd multiplication, the subproducts are OpenMP tasks */
+void matrix_mult_strassen(matrix_t* a, matrix_t* b, matrix_t* r)
+{
+    #pragma omp parallel
+    #pragma omp single
+    strassen_mult(r->rows, r->cols, a->cols,
+                  (const kernel_elem_t *) a->data, a->cols,
+                  (const kernel_elem_t *) b->data, b->cols,
+                  (kernel_elem_t *) r->data, r->cols, strassen_cutoff);
+}
+
+
+/* Recursive multiplication splitting the largest dimension, see recursive.h */
+void matrix_mult_recursive(matrix_t* a, matrix_t* b, matrix_t* r)
+{
+    #pragma omp parallel
+    #pragma omp single
+    recursive_mult(r->rows, r->cols, a->cols,
+                   (const kernel_elem_t *) a->data, a->cols,
+                   (const kernel_elem_t *) b->data, b->cols,
+                   (kernel_elem_t *) r->data, r->cols, false);
+}
+
+
+/* R = A * B for sparse A, row by row with B sparse or dense (see csr.h). The rows
+ * differ in their number of elements, so they are handed out dynamically. */
+void matrix_mult_sparse(matrix_t* a, matrix_t* b, matrix_t* r)
+{
+    int i;
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (i = 0; i < r->rows; ++i) {
+        if (b->sparse != NULL) {
+            csr_spgemm_rows(a->sparse, b->sparse, i, i + 1, r->data, r->cols);
+        } else {
+            csr_spmm_rows(a->sparse, b->data, b->cols, b->cols, i, i + 1, r->data, r->cols);
+        }
+    }
+}
+
+
 bool matrix_mult_simple(matrix_t* a, matrix_t* b, matrix_t* r)
 {
     if (a->cols != b->rows) {
@@ -95,51 +366,497 @@ bool matrix_mult_simple(matrix_t* a, matrix_t* b, matrix_t* r)
         return false;
     }
 
-    matrix_mult(a, b, r);
+    // Sparse A is multiplied row by row, a sparse B alone is expanded for the dense kernels
+    if (a->sparse == NULL && b->sparse != NULL) {
+        densify_matrix(b);
+    }
+
+    if (a->sparse != NULL) {
+        matrix_mult_sparse(a, b, r);
+    } else if (strassen_cutoff > 0) {
+        matrix_mult_strassen(a, b, r);
+    } else if (recursive) {
+        matrix_mult_recursive(a, b, r);
+    } else if (numa.enabled) {
+        matrix_mult_numa(a, b, r);
+    } else {
+        matrix_mult(a, b, r);
+    }
+
+    return true;
+}
+
+
+/* Check r = a * b with Freivalds' algorithm (see freivalds.h), modulo 2^64 like
+ * the multiplication. Returns the number of failed trials. */
+int matrix_verify(matrix_t* a, matrix_t* b, matrix_t* r, int trials)
+{
+    uint64_t* x = malloc(b->cols * sizeof(uint64_t));
+    uint64_t* y = malloc(b->rows * sizeof(uint64_t));
+    uint64_t seed = freivalds_seed();
+    int trial, i, failed = 0;
+
+    if (x == NULL || y == NULL) {
+        perror("Could not allocate memory for verification!");
+        exit(EXIT_FAILURE);
+    }
+
+    for (trial = 0; trial < trials; ++trial) {
+        int wrong = 0;
+
+        for (i = 0; i < b->cols; ++i) {
+            x[i] = freivalds_x(seed, trial, i);
+        }
+
+        // y = B * x
+        #pragma omp parallel for schedule(static)
+        for (i = 0; i < b->rows; ++i) {
+            if (b->sparse != NULL) {
+                y[i] = csr_row_dot(b->sparse, i, x);
+                continue;
+            }
+            const uint64_t* bi = (const uint64_t*) &b->data[(size_t) i * b->cols];
+            uint64_t sum = 0;
+            for (int j = 0; j < b->cols; ++j) {
+                sum += bi[j] * x[j];
+            }
+            y[i] = sum;
+        }
+
+        // Compare A * y with R * x
+        #pragma omp parallel for schedule(static) reduction(+:wrong)
+        for (i = 0; i < a->rows; ++i) {
+            const uint64_t* ri = (const uint64_t*) &r->data[(size_t) i * r->cols];
+            uint64_t ay = 0, rx = 0;
+            if (a->sparse != NULL) {
+                ay = csr_row_dot(a->sparse, i, y);
+            } else {
+                const uint64_t* ai = (const uint64_t*) &a->data[(size_t) i * a->cols];
+                for (int k = 0; k < a->cols; ++k) {
+                    ay += ai[k] * y[k];
+                }
+            }
+            for (int j = 0; j < r->cols; ++j) {
+                rx += ri[j] * x[j];
+            }
+            wrong += (ay != rx);
+        }
+
+        failed += (wrong > 0);
+    }
+
+    free(x);
+    free(y);
+    return failed;
+}
+
+
+/* Benchmark mode for the other element types (-e), see typed.h */
+void matrix_mult_bench_typed(bench_options* bench, int t, uint32_t type)
+{
+    int i, n = bench->size;
+    size_t count = (size_t) n * n, j;
+    typed_matrix_t a = { n, n, type, NULL };
+    typed_matrix_t b = a;
+    typed_matrix_t r = a;
+
+    a.data = malloc(count * matfile_elem_size(type));
+    b.data = malloc(count * matfile_elem_size(type));
+    double* fill = malloc(count * sizeof(double));
+    double* times = malloc(bench->reps * sizeof(double));
+    if (a.data == NULL || b.data == NULL || fill == NULL || times == NULL) {
+        perror("Could not allocate memory for benchmark!");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < 2; ++i) {
+        void* dst = i ? b.data : a.data;
+        bench_fill_double(fill, count, 1000.0, i + 1);
+        for (j = 0; j < count; ++j) {
+            if (type == MATFILE_INT32) {
+                ((int32_t*) dst)[j] = (int32_t) fill[j];
+            } else if (type == MATFILE_FLOAT) {
+                ((float*) dst)[j] = (float) fill[j];
+            } else {
+                ((double*) dst)[j] = fill[j];
+            }
+        }
+    }
+
+    for (i = -bench->warmups; i < bench->reps; ++i) {
+        double start = omp_get_wtime();
+        typed_mult(&a, &b, &r);
+        if (i >= 0) {
+            times[i] = omp_get_wtime() - start;
+        }
+        typed_free(&r);
+    }
+    bench_report("mmul_omp", matfile_type_name(type), n, t, times, bench->reps);
+
+    free(times);
+    free(fill);
+    typed_free(&a);
+    typed_free(&b);
+}
+
+
+/* Multiply the files with the kernel of another element type than int64 (-e or
+ * the type of a binary A) and write the result, see typed.h */
+bool matrix_mult_files_typed(char* path_a, char* path_b, uint32_t type, matwrite_mode mode, char* output, int t)
+{
+    typed_matrix_t a = { 0, 0, type, NULL };
+    typed_matrix_t b = a;
+    typed_matrix_t r = a;
+
+    // Both matrices are read at the same time
+    bool read_a = false, read_b = false;
+    #pragma omp parallel sections num_threads(2)
+    {
+        #pragma omp section
+        read_a = typed_read(path_a, &a, t);
+
+        #pragma omp section
+        read_b = typed_read(path_b, &b, t);
+    }
+
+    if (!read_a || !read_b) {
+        fputs(read_a ? "could not read input matrix B" : "could not read input matrix A", stderr);
+        return false;
+    }
+
+    pin_threads();
+    bool multiplied = typed_mult(&a, &b, &r);
+    unpin_master();
 
+    if (multiplied) {
+        // Write to stdout unless an output file is given
+        int fd = STDOUT_FILENO;
+        if (output != NULL && (fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+            perror("Could not create file!");
+            return false;
+        }
+        if (!typed_print(&r, mode, fd, t)) {
+            fputs("could not write the result matrix", stderr);
+        }
+        if (fd != STDOUT_FILENO) {
+            close(fd);
+        }
+    } else {
+        fputs("could not multiply: mismatch between number of rows and columns in input matricess.", stderr);
+    }
+
+    typed_free(&a);
+    typed_free(&b);
+    typed_free(&r);
     return true;
 }
 
 
+/* Benchmark mode: time the multiplication of synthetic operands, see bench.h */
+void matrix_mult_bench(bench_options* bench, int t)
+{
+    int i, n = bench->size;
+    matrix_t a = { 0 };
+    matrix_t b = a;
+    matrix_t r = a;
+
+    a.rows = a.cols = b.rows = b.cols = n;
+    a.data = malloc((size_t) n * n * sizeof(matrix_elem_t));
+    b.data = malloc((size_t) n * n * sizeof(matrix_elem_t));
+    double* times = malloc(bench->reps * sizeof(double));
+    if (a.data == NULL || b.data == NULL || times == NULL) {
+        perror("Could not allocate memory for benchmark!");
+        exit(EXIT_FAILURE);
+    }
+    bench_fill_int64(a.data, (size_t) n * n, 1000, 1);
+    bench_fill_int64(b.data, (size_t) n * n, 1000, 2);
+
+    for (i = -bench->warmups; i < bench->reps; ++i) {
+        double start = omp_get_wtime();
+        if (!matrix_mult_simple(&a, &b, &r)) {
+            perror("Could not allocate memory for result matrix!");
+            exit(EXIT_FAILURE);
+        }
+        if (i >= 0) {
+            times[i] = omp_get_wtime() - start;
+        }
+        free(r.data);
+    }
+    // The algorithm picked by matrix_mult_simple is part of the label
+    bench_report(strassen_cutoff > 0 ? "mmul_omp_strassen" : recursive ? "mmul_omp_recursive" : "mmul_omp",
+                 "int64", n, t, times, bench->reps);
+
+    free(times);
+    free(a.data);
+    free(b.data);
+}
+
+/* Batched mode (-m): all products of the pairs in path */
+static bool matrix_mult_batch(const char *path, matwrite_mode mode, const char *output)
+{
+    batch_t batch;
+    bool ok;
+
+    if (mode == MATWRITE_BINARY) {
+        fputs("the batched mode writes text or the sum only\n", stderr);
+        return false;
+    }
+    if (!batch_read(path, &batch)) {
+        return false;
+    }
+
+    double start = omp_get_wtime();
+    batch_mult(&batch);
+    double seconds = omp_get_wtime() - start;
+    fprintf(stderr, "Batch: %zu products in %lf s, %.0lf products/s\n", batch.count, seconds,
+            seconds > 0 ? batch.count / seconds : 0.0);
+
+    int fd = STDOUT_FILENO;
+    if (output != NULL && (fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        perror("Could not create file!");
+        batch_free(&batch);
+        return false;
+    }
+    if (!(ok = batch_print(&batch, mode, fd))) {
+        fputs("could not write the results", stderr);
+    }
+    if (fd != STDOUT_FILENO) {
+        close(fd);
+    }
+    batch_free(&batch);
+    return ok;
+}
+
+
 int main(int argc, char* argv[])
 {
     double time_1 = omp_get_wtime();
 
-    matrix_t a = { 0, 0, NULL };
+    matrix_t a = { 0 };
     matrix_t b = a;
     matrix_t r = a;
 
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <file1> <file2> <threadcount>\n", argv[0]);
+    matwrite_mode mode = MATWRITE_TEXT;
+    char * output = NULL;
+    int opt;
+    bench_options bench = BENCH_DEFAULTS;
+    int verify = 0;     // Freivalds trials, 0 without --verify
+    uint32_t type = 0;  // Element type (matfile.h), by default the one of A
+    char * batch_input = NULL;
+    size_t ooc_memory = 0;  // Buffer memory of the out-of-core mode, 0 without -x
+
+    static const struct option long_options[] = {
+        { "verify", optional_argument, NULL, 'V' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "o:f:np:rs:cb:w:k:e:m:x:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'V':
+            if ((verify = freivalds_parse(optarg)) < 0) {
+                fprintf(stderr, "Invalid number of trials %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'c':
+            recursive = true;
+            break;
+        case 'e':
+            if ((type = matfile_type_from_name(optarg)) == 0) {
+                fprintf(stderr, "Unknown element type %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 's':
+            strassen_cutoff = (int) strtol(optarg, NULL, 0);
+            if (strassen_cutoff < 1) {
+                fprintf(stderr, "Invalid Strassen cutoff %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            bench.size = (int) strtol(optarg, NULL, 0);
+            break;
+        case 'w':
+            bench.warmups = (int) strtol(optarg, NULL, 0);
+            break;
+        case 'k':
+            bench.reps = (int) strtol(optarg, NULL, 0);
+            break;
+        case 'n':
+            numa.enabled = true;
+            break;
+        case 'p':
+            if ((numa.ncpus = affinity_parse(optarg, &numa.cpus)) < 0) {
+                fprintf(stderr, "Invalid CPU list %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r':
+            numa.enabled = true;
+            numa.replicate = true;
+            break;
+        case 'o':
+            if (!matwrite_parse_mode(optarg, &mode)) {
+                fprintf(stderr, "Unknown output mode %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'f':
+            output = optarg;
+            break;
+        case 'm':
+            batch_input = optarg;
+            break;
+        case 'x':
+            if ((ooc_memory = ooc_parse_size(optarg)) == 0) {
+                fprintf(stderr, "Invalid memory size %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            argc = 0;   // Print the usage
+        }
+    }
+
+    // In benchmark mode the operands are generated, only the thread count is given
+    if (argc - optind != (bench.size > 0 || batch_input != NULL ? 1 : 3) || bench.size < 0 || bench.warmups < 0 || bench.reps < 1) {
+        fprintf(stderr, "Usage: %s [-o text|binary|sum] [-f <output file>] [-n] [-r] [-p <cpus>] [-s <cutoff> | -c] [-e <type>] [--verify[=<trials>]] <file1> <file2> <threadcount>\n", argv[0]);
+        fprintf(stderr, "       %s -b <size> [-w <warmups>] [-k <reps>] [-n] [-r] [-p <cpus>] [-s <cutoff> | -c] [-e <type>] <threadcount>\n", argv[0]);
+        fprintf(stderr, "       %s -x <memory> -f <output file> [-o sum] <file1> <file2> <threadcount>\n", argv[0]);
+        fprintf(stderr, "       %s -m <pairs file> [-o text|sum] [-f <output file>] <threadcount>\n", argv[0]);
+        fprintf(stderr, "  -n  NUMA mode: place A, R and B on the nodes of the threads using them\n");
+        fprintf(stderr, "  -r  NUMA mode with one copy of B per node\n");
+        fprintf(stderr, "  -p  pin thread i to the i-th CPU of the list, e.g. 0-7,16-23\n");
+        fprintf(stderr, "  -s  Strassen-Winograd multiplication down to the cutoff size (e.g. 128)\n");
+        fprintf(stderr, "  -c  cache oblivious recursive multiplication\n");
+        fprintf(stderr, "  -e  element type int32, int64, float or double (default: type of a binary\n");
+        fprintf(stderr, "      file1, int64 for text), only int64 supports -n, -r, -s, -c and --verify\n");
+        fprintf(stderr, "  --verify  check the result with Freivalds' algorithm (default: %d trials)\n", FREIVALDS_TRIALS);
+        fprintf(stderr, "  -b  benchmark the multiplication of two generated size x size matrices\n");
+        fprintf(stderr, "      (default: 1 warmup, 5 repetitions) and print the timings as CSV\n");
+        fprintf(stderr, "  -x  out-of-core: stream tiles of binary int64 operands through at most\n");
+        fprintf(stderr, "      <memory> bytes of buffers (e.g. 48G) and write R to the output file\n");
+        fprintf(stderr, "  -m  multiply all pairs of int64 matrices of a text stream (- for stdin)\n");
         return EXIT_FAILURE;
     }
+    argv += optind - 1;
 
-    int t = (int) strtol(argv[3], NULL, 0); // Number of threads
+    int t = (int) strtol(argv[bench.size > 0 || batch_input != NULL ? 1 : 3], NULL, 0); // Number of threads
     omp_set_num_threads(t);
 
-    if (!read_matrix(argv[1], &a)) {
+    if (batch_input != NULL && (ooc_memory > 0 || bench.size > 0)) {
+        fputs("-m can't be combined with -x and -b\n", stderr);
+        return EXIT_FAILURE;
+    }
+    if (batch_input != NULL) {
+        return matrix_mult_batch(batch_input, mode, output) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // NUMA mode pins the threads, by default to the CPUs the process may use
+    if (numa.enabled && numa.cpus == NULL && (numa.ncpus = affinity_default(&numa.cpus)) < 1) {
+        fputs("Could not determine the CPUs of the process, NUMA mode is off\n", stderr);
+        free(numa.cpus);
+        numa.cpus = NULL;
+        numa.enabled = false;
+        numa.replicate = false;
+    }
+
+    if (type == 0) {
+        type = (bench.size > 0) ? MATFILE_INT64 : typed_file_type(argv[1]);
+    }
+    if (type != MATFILE_INT64 && (numa.enabled || strassen_cutoff > 0 || recursive || verify > 0)) {
+        fprintf(stderr, "-n, -r, -s, -c and --verify need int64 elements, not %s\n", matfile_type_name(type));
+        return EXIT_FAILURE;
+    }
+    if (ooc_memory > 0 && (numa.enabled || strassen_cutoff > 0 || recursive || verify > 0 || bench.size > 0)) {
+        fputs("-x can't be combined with -n, -r, -s, -c, -b and --verify\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (bench.size > 0) {
+        pin_threads();
+        if (type == MATFILE_INT64) {
+            matrix_mult_bench(&bench, t);
+        } else {
+            matrix_mult_bench_typed(&bench, t, type);
+        }
+        unpin_master();
+        free(numa.cpus);
+        return EXIT_SUCCESS;
+    }
+
+    if (ooc_memory > 0) {
+        // The I/O threads of ooc_mult are started by the master, which keeps its CPUs
+        pin_threads();
+        unpin_master();
+        bool ok = ooc_mult(argv[1], argv[2], output, mode, ooc_memory);
+        free(numa.cpus);
+        fprintf(stderr, "%lf\n", omp_get_wtime() - time_1);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (type != MATFILE_INT64) {
+        bool ok = matrix_mult_files_typed(argv[1], argv[2], type, mode, output, t);
+        free(numa.cpus);
+        fprintf(stderr, "%lf\n", omp_get_wtime() - time_1);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Both matrices are read at the same time
+    bool read_a = false, read_b = false;
+    #pragma omp parallel sections num_threads(2)
+    {
+        #pragma omp section
+        read_a = read_matrix(argv[1], &a, t);
+
+        #pragma omp section
+        read_b = read_matrix(argv[2], &b, t);
+    }
+
+    if (!read_a) {
         fputs("could not read input matrix A", stderr);
         return EXIT_FAILURE;
     }
 
-    if (!read_matrix(argv[2], &b)) {
+    if (!read_b) {
         fputs("could not read input matrix B", stderr);
         return EXIT_FAILURE;
     }
 
-    if (matrix_mult_simple(&a, &b, &r)) {
-        print_matrix(r);
+    bool verified = true;
+    pin_threads();
+    bool multiplied = matrix_mult_simple(&a, &b, &r);
+    if (multiplied && verify > 0) {
+        verified = freivalds_report(verify, matrix_verify(&a, &b, &r, verify));
+    }
+    unpin_master();
+
+    if (multiplied) {
+
+        // Write to stdout unless an output file is given
+        int fd = STDOUT_FILENO;
+        if (output != NULL && (fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+            perror("Could not create file!");
+            return EXIT_FAILURE;
+        }
+        if (!print_matrix(r, mode, fd, t)) {
+            fputs("could not write the result matrix", stderr);
+        }
+        if (fd != STDOUT_FILENO) {
+            close(fd);
+        }
     } else {
         fputs("could not multiply: mismatch between number of rows and columns in input matricess.", stderr);
     }
 
-    free(a.data);
-    free(b.data);
-    free(r.data);
+    free_matrix(&a);
+    free_matrix(&b);
+    free_matrix(&r);
+    free(numa.cpus);
 
     double time_2 = omp_get_wtime();
     fprintf(stderr, "%lf\n", time_2 - time_1);
 
-    return EXIT_SUCCESS;
+    return verified ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,459 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#include "kernel.h"
+#include "matfile.h"
+#include "ooc.h"
+
+typedef struct {
+    int fd_a, fd_b, fd_r;
+    uint64_t off_a, off_b, off_r;       // Data offsets of the files
+    uint64_t m, k, n;                   // A is m x k, B k x n
+    uint64_t tile;                      // Tile edge
+    uint64_t nbi, nbj, nbk;             // Number of tiles along m, n and k
+    uint64_t steps;                     // Tile products, nbi * nbj * nbk
+
+    int64_t *a[OOC_SLOTS], *b[OOC_SLOTS], *r[2];
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t next_load;                 // Next operand tile to read, two per step
+    uint64_t consumed;                  // Steps the compute threads are done with
+    int loaded[OOC_SLOTS];              // Operands of the step in a slot that are read
+    uint64_t writes;                    // Tiles of R handed to the writer
+    uint64_t written;                   // Tiles of R on disk
+    bool done;                          // No more tiles of R will come
+    bool failed;
+    uint64_t bytes_read;
+} ooc_state;
+
+size_t ooc_parse_size(const char *arg)
+{
+    char *end;
+    unsigned long long size;
+
+    errno = 0;
+    size = strtoull(arg, &end, 10);
+    if (errno != 0 || end == arg) {
+        return 0;
+    }
+    switch (*end) {
+    case 'T': case 't': size <<= 10; /* fall through */
+    case 'G': case 'g': size <<= 10; /* fall through */
+    case 'M': case 'm': size <<= 10; /* fall through */
+    case 'K': case 'k': size <<= 10; ++end; break;
+    }
+    return (*end == '\0') ? (size_t) size : 0;
+}
+
+/* Number of rows or columns of tile t of a dimension */
+static uint64_t extent(const ooc_state *s, uint64_t t, uint64_t dim)
+{
+    return (dim - t * s->tile < s->tile) ? dim - t * s->tile : s->tile;
+}
+
+/* The step's tiles: row tile bi and column tile bj of R, bk along k.
+ * k runs fastest so every tile of R is finished before the next starts. */
+static void step_tiles(const ooc_state *s, uint64_t step, uint64_t *bi, uint64_t *bj, uint64_t *bk)
+{
+    *bk = step % s->nbk;
+    *bj = step / s->nbk % s->nbj;
+    *bi = step / s->nbk / s->nbj;
+}
+
+static bool pread_all(int fd, void *buf, size_t len, uint64_t off)
+{
+    while (len > 0) {
+        ssize_t got = pread(fd, buf, len, (off_t) off);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf = (char *) buf + got;
+        len -= got;
+        off += got;
+    }
+    return true;
+}
+
+static bool pwrite_all(int fd, const void *buf, size_t len, uint64_t off)
+{
+    while (len > 0) {
+        ssize_t put = pwrite(fd, buf, len, (off_t) off);
+        if (put < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf = (const char *) buf + put;
+        len -= put;
+        off += put;
+    }
+    return true;
+}
+
+/* Read or write the block [i0, i0 + rows) x [j0, j0 + width) of a row major
+ * matrix with the given number of columns: one pread/pwrite per row, or a
+ * single one if the block spans whole rows */
+static bool transfer_block(int fd, uint64_t off, uint64_t cols, uint64_t i0, uint64_t rows,
+                           uint64_t j0, uint64_t width, int64_t *buf, bool write)
+{
+    uint64_t i, n = 1;
+
+    if (width == cols) {
+        n = rows;
+        rows = 1;
+    }
+    for (i = 0; i < rows; ++i) {
+        uint64_t pos = off + ((i0 + i) * cols + j0) * sizeof(int64_t);
+        size_t len = n * width * sizeof(int64_t);
+        if (!(write ? pwrite_all(fd, buf + i * width, len, pos) : pread_all(fd, buf + i * width, len, pos))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* I/O thread: reads the operand tiles in order, two per step (A, then B).
+ * The tiles of a step go to slot step % OOC_SLOTS once the compute threads
+ * are done with the step that used it before. */
+static void *reader(void *arg)
+{
+    ooc_state *s = arg;
+    uint64_t job, step, bi, bj, bk;
+    bool ok;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        job = s->next_load++;
+        step = job / 2;
+        while (!s->failed && step < s->steps && step >= s->consumed + OOC_SLOTS) {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        if (s->failed || step >= s->steps) {
+            pthread_mutex_unlock(&s->lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        step_tiles(s, step, &bi, &bj, &bk);
+        uint64_t rows = extent(s, bi, s->m), inner = extent(s, bk, s->k), cols = extent(s, bj, s->n);
+        if (job % 2 == 0) {
+            ok = transfer_block(s->fd_a, s->off_a, s->k, bi * s->tile, rows, bk * s->tile, inner,
+                                s->a[step % OOC_SLOTS], false);
+        } else {
+            ok = transfer_block(s->fd_b, s->off_b, s->n, bk * s->tile, inner, bj * s->tile, cols,
+                                s->b[step % OOC_SLOTS], false);
+        }
+
+        pthread_mutex_lock(&s->lock);
+        if (ok) {
+            ++s->loaded[step % OOC_SLOTS];
+            s->bytes_read += (job % 2 == 0 ? rows : cols) * inner * sizeof(int64_t);
+        } else {
+            perror("Could not read a tile!");
+            s->failed = true;
+        }
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+/* I/O thread: writes the finished tiles of R in order from the two R buffers */
+static void *writer(void *arg)
+{
+    ooc_state *s = arg;
+    uint64_t t;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->failed && !s->done && s->written == s->writes) {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        if (s->failed || s->written == s->writes) {
+            pthread_mutex_unlock(&s->lock);
+            return NULL;
+        }
+        t = s->written;
+        pthread_mutex_unlock(&s->lock);
+
+        uint64_t bi = t / s->nbj, bj = t % s->nbj;
+        bool ok = transfer_block(s->fd_r, s->off_r, s->n, bi * s->tile, extent(s, bi, s->m),
+                                 bj * s->tile, extent(s, bj, s->n), s->r[t % 2], true);
+
+        pthread_mutex_lock(&s->lock);
+        if (ok) {
+            ++s->written;
+        } else {
+            perror("Could not write a tile!");
+            s->failed = true;
+        }
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+/* Conditions the compute threads wait for */
+static bool tiles_read(const ooc_state *s, uint64_t slot)
+{
+    return s->loaded[slot] == 2;
+}
+
+static bool buffer_free(const ooc_state *s, uint64_t t)
+{
+    return s->written + 2 > t;      // Tile t - 2 of R, which used the same buffer, is written
+}
+
+static bool all_written(const ooc_state *s, uint64_t unused)
+{
+    (void) unused;
+    return s->written == s->writes;
+}
+
+/* Wait until cond(s, arg) holds and add the time waited to *seconds.
+ * Returns false if an I/O thread failed. */
+static bool wait_until(ooc_state *s, bool (*cond)(const ooc_state *, uint64_t), uint64_t arg, double *seconds)
+{
+    double start = omp_get_wtime();
+    bool ok;
+
+    pthread_mutex_lock(&s->lock);
+    while (!s->failed && !cond(s, arg)) {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    ok = !s->failed;
+    pthread_mutex_unlock(&s->lock);
+    *seconds += omp_get_wtime() - start;
+    return ok;
+}
+
+/* The compute part: multiply the tiles of every step as soon as they are read */
+static void compute(ooc_state *s, double *busy, double *wait_read, double *wait_write)
+{
+    uint64_t step, bi, bj, bk;
+
+    for (step = 0; step < s->steps; ++step) {
+        int slot = step % OOC_SLOTS;
+        step_tiles(s, step, &bi, &bj, &bk);
+        uint64_t t = bi * s->nbj + bj;
+
+        if (!wait_until(s, tiles_read, slot, wait_read)
+            || (bk == 0 && !wait_until(s, buffer_free, t, wait_write))) {
+            break;
+        }
+
+        int rows = (int) extent(s, bi, s->m), inner = (int) extent(s, bk, s->k), cols = (int) extent(s, bj, s->n);
+        const kernel_elem_t *a = (const kernel_elem_t *) s->a[slot];
+        const kernel_elem_t *b = (const kernel_elem_t *) s->b[slot];
+        kernel_elem_t *r = (kernel_elem_t *) s->r[t % 2];
+        double start = omp_get_wtime();
+        int i;
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (i = 0; i < rows; i += OOC_ROWS) {
+            int n = (rows - i < OOC_ROWS) ? rows - i : OOC_ROWS;
+            kernel_mult(n, cols, inner, a + (size_t) i * inner, inner, b, cols,
+                        r + (size_t) i * cols, cols, bk > 0);
+        }
+        *busy += omp_get_wtime() - start;
+
+        pthread_mutex_lock(&s->lock);
+        s->loaded[slot] = 0;
+        ++s->consumed;
+        if (bk == s->nbk - 1) {
+            ++s->writes;
+        }
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->done = true;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    wait_until(s, all_written, 0, wait_write);
+}
+
+/* Open an operand, which has to be a binary int64 row major matrix */
+static bool open_operand(const char *path, int *fd, matfile_header *hdr)
+{
+    matfile_t mf;
+
+    if (!matfile_is_binary(path)) {
+        fprintf(stderr, "%s: the out-of-core mode needs binary matrices (see matconv)\n", path);
+        return false;
+    }
+    if (!matfile_open(path, &mf)) {
+        return false;
+    }
+    *hdr = mf.hdr;
+    if (!matfile_matches(&mf, MATFILE_INT64, false)) {
+        fprintf(stderr, "%s: the out-of-core mode needs int64 elements stored row by row\n", path);
+        matfile_close(&mf);
+        return false;
+    }
+    matfile_close(&mf);
+
+    if ((*fd = open(path, O_RDONLY)) < 0) {
+        perror(path);
+        return false;
+    }
+    posix_fadvise(*fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+}
+
+/* Sum and hash of the written result, read back in pieces */
+static bool print_sum(const ooc_state *s)
+{
+    size_t chunk = (size_t) 1 << 20, count = s->m * s->n, i, pos;
+    int64_t *buf = malloc(chunk * sizeof(int64_t));
+    uint64_t sum = 0, hash = MATWRITE_HASH_INIT;
+    char line[64];
+
+    if (buf == NULL) {
+        perror("Could not allocate memory!");
+        exit(EXIT_FAILURE);
+    }
+    for (pos = 0; pos < count; pos += chunk) {
+        size_t len = (count - pos < chunk) ? count - pos : chunk;
+        if (!pread_all(s->fd_r, buf, len * sizeof(int64_t), s->off_r + pos * sizeof(int64_t))) {
+            perror("Could not read the result!");
+            free(buf);
+            return false;
+        }
+        for (i = 0; i < len; ++i) {
+            sum += (uint64_t) buf[i];
+        }
+        hash = matwrite_hash_update(hash, buf, len);
+    }
+    free(buf);
+
+    snprintf(line, sizeof(line), "sum: %lld\nhash: %016llx\n", (long long) sum, (unsigned long long) hash);
+    return matwrite_str(STDOUT_FILENO, line);
+}
+
+bool ooc_mult(const char *path_a, const char *path_b, const char *output,
+              matwrite_mode mode, size_t memory)
+{
+    ooc_state s = { .fd_a = -1, .fd_b = -1, .fd_r = -1 };
+    matfile_header ha, hb, hr;
+    pthread_t readers[OOC_READERS], write_thread;
+    double busy = 0, wait_read = 0, wait_write = 0, start = omp_get_wtime();
+    bool ok = false;
+    int i, started = 0;
+
+    if (output == NULL) {
+        fputs("the out-of-core mode needs an output file (-f)\n", stderr);
+        return false;
+    }
+    if (!open_operand(path_a, &s.fd_a, &ha) || !open_operand(path_b, &s.fd_b, &hb)) {
+        goto out;
+    }
+    if (ha.cols != hb.rows || ha.rows == 0 || ha.cols == 0 || hb.cols == 0) {
+        fputs("could not multiply: mismatch between number of rows and columns in input matrices.\n", stderr);
+        goto out;
+    }
+    s.m = ha.rows;
+    s.k = ha.cols;
+    s.n = hb.cols;
+    s.off_a = ha.data_offset;
+    s.off_b = hb.data_offset;
+
+    // 2 * OOC_SLOTS + 2 tiles of tile x tile elements fit into the memory, rounded to the kernel's blocks
+    s.tile = (uint64_t) sqrt((double) memory / ((2 * OOC_SLOTS + 2) * sizeof(int64_t)));
+    s.tile -= s.tile % OOC_ROWS;
+    if (s.tile == 0) {
+        fprintf(stderr, "%zu bytes are too little for the out-of-core mode\n", memory);
+        goto out;
+    }
+    s.nbi = (s.m + s.tile - 1) / s.tile;
+    s.nbj = (s.n + s.tile - 1) / s.tile;
+    s.nbk = (s.k + s.tile - 1) / s.tile;
+    s.steps = s.nbi * s.nbj * s.nbk;
+
+    uint64_t tm = extent(&s, 0, s.m), tk = extent(&s, 0, s.k), tn = extent(&s, 0, s.n);
+    for (i = 0; i < OOC_SLOTS; ++i) {
+        s.a[i] = malloc(tm * tk * sizeof(int64_t));
+        s.b[i] = malloc(tk * tn * sizeof(int64_t));
+        if (s.a[i] == NULL || s.b[i] == NULL) {
+            perror("Could not allocate memory for the tiles!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (i = 0; i < 2; ++i) {
+        if ((s.r[i] = malloc(tm * tn * sizeof(int64_t))) == NULL) {
+            perror("Could not allocate memory for the tiles!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // The header is written first, the tiles of R go to their place in the file
+    matfile_init_header(&hr, MATFILE_INT64, s.m, s.n, 0);
+    s.off_r = hr.data_offset;
+    if ((s.fd_r = open(output, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0
+        || ftruncate(s.fd_r, (off_t) (s.off_r + s.m * s.n * sizeof(int64_t))) != 0
+        || !pwrite_all(s.fd_r, &hr, sizeof(hr), 0)) {
+        perror("Could not create file!");
+        goto out;
+    }
+
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.cond, NULL);
+    for (started = 0; started < OOC_READERS; ++started) {
+        if (pthread_create(&readers[started], NULL, reader, &s) != 0) {
+            perror("Could not create thread!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (pthread_create(&write_thread, NULL, writer, &s) != 0) {
+        perror("Could not create thread!");
+        exit(EXIT_FAILURE);
+    }
+
+    compute(&s, &busy, &wait_read, &wait_write);
+
+    for (i = 0; i < started; ++i) {
+        pthread_join(readers[i], NULL);
+    }
+    pthread_join(write_thread, NULL);
+    pthread_cond_destroy(&s.cond);
+    pthread_mutex_destroy(&s.lock);
+
+    ok = !s.failed;
+    fprintf(stderr, "Out-of-core: tiles of %llu, %.2lf GiB read, %.2lf s total, %.2lf s multiplying, "
+            "%.2lf s waiting for reads, %.2lf s for writes\n", (unsigned long long) s.tile,
+            s.bytes_read / (1024.0 * 1024 * 1024), omp_get_wtime() - start, busy, wait_read, wait_write);
+
+    if (ok && mode == MATWRITE_SUM) {
+        ok = print_sum(&s);
+    }
+
+out:
+    for (i = 0; i < OOC_SLOTS; ++i) {
+        free(s.a[i]);
+        free(s.b[i]);
+    }
+    free(s.r[0]);
+    free(s.r[1]);
+    if (s.fd_a >= 0) {
+        close(s.fd_a);
+    }
+    if (s.fd_b >= 0) {
+        close(s.fd_b);
+    }
+    if (s.fd_r >= 0 && close(s.fd_r) != 0) {
+        perror("Could not write file!");
+        ok = false;
+    }
+    return ok;
+}
@@ -0,0 +1,37 @@
+#ifndef OOC_H
+#define OOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "matwrite.h"
+
+/* Out-of-core multiplication (mmul_omp -x) for operands larger than memory.
+ *
+ * A, B and R are binary int64 row major matrices on disk (see matfile.h)
+ * and are never held in memory as a whole. R is calculated tile by tile:
+ * for every tile of R the tiles of A and B along k are streamed through a
+ * fixed pool of OOC_SLOTS buffers and multiplied with the blocked kernel,
+ * the finished tile goes to a writer thread. OOC_READERS I/O threads read
+ * the next tiles with pread while the OpenMP threads multiply the ones
+ * already resident, so with large enough tiles the disk only has to keep
+ * up with O(n^3 / tile) bytes and the multiplication runs at kernel speed.
+ *
+ * The tile size follows from the memory given: the pool holds OOC_SLOTS
+ * tiles each of A and B plus two tiles of R. */
+
+#define OOC_SLOTS 3         // Tiles of A and B in the buffer pool
+#define OOC_READERS 2       // I/O threads reading tiles
+#define OOC_ROWS 64         // Rows of a tile per OpenMP iteration
+
+/* Parse a memory size like 512M or 48G (K, M, G, T are powers of 1024),
+ * returns 0 if arg isn't one */
+size_t ooc_parse_size(const char *arg);
+
+/* Multiply the binary matrices in path_a and path_b into the binary matrix
+ * output using at most memory bytes of buffers. R is always written as a
+ * binary matrix; with MATWRITE_SUM its sum and hash are printed to stdout
+ * afterwards. Prints a message and returns false on errors. */
+bool ooc_mult(const char *path_a, const char *path_b, const char *output,
+              matwrite_mode mode, size_t memory);
+
+#endif /* OOC_H */
@@ -0,0 +1,39 @@
+#include "recursive.h"
+
+// Products with at most RECURSIVE_BASE^3 multiplications are not split further
+#define RECURSIVE_BASE 64
+
+// Smaller products are not worth a task of their own
+#define RECURSIVE_MIN_TASK (4L * RECURSIVE_BASE * RECURSIVE_BASE * RECURSIVE_BASE)
+
+void recursive_mult(int m, int n, int k,
+                    const kernel_elem_t *a, size_t lda,
+                    const kernel_elem_t *b, size_t ldb,
+                    kernel_elem_t *c, size_t ldc, bool add)
+{
+    long work = (long) m * n * k;
+    int h;
+
+    if (work <= (long) RECURSIVE_BASE * RECURSIVE_BASE * RECURSIVE_BASE) {
+        kernel_mult(m, n, k, a, lda, b, ldb, c, ldc, add);
+    } else if (m >= n && m >= k) {
+        // Upper and lower rows of A and C
+        h = m / 2;
+        #pragma omp task if (work >= RECURSIVE_MIN_TASK)
+        recursive_mult(h, n, k, a, lda, b, ldb, c, ldc, add);
+        recursive_mult(m - h, n, k, a + h * lda, lda, b, ldb, c + h * ldc, ldc, add);
+        #pragma omp taskwait
+    } else if (n >= k) {
+        // Left and right columns of B and C
+        h = n / 2;
+        #pragma omp task if (work >= RECURSIVE_MIN_TASK)
+        recursive_mult(m, h, k, a, lda, b, ldb, c, ldc, add);
+        recursive_mult(m, n - h, k, a, lda, b + h, ldb, c + h, ldc, add);
+        #pragma omp taskwait
+    } else {
+        // Both halves of k add to all of C, so they can't run at the same time
+        h = k / 2;
+        recursive_mult(m, n, h, a, lda, b, ldb, c, ldc, add);
+        recursive_mult(m, n, k - h, a + h, lda, b + h * ldb, ldb, c, ldc, true);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef RECURSIVE_H
+#define RECURSIVE_H
+
+#include "kernel.h"
+
+/* Cache oblivious multiplication: the largest of m, n and k is halved
+ * recursively until the product is small enough for kernel_mult. Halves
+ * of m or n write disjoint parts of C and are OpenMP tasks, halves of k
+ * are computed one after the other into the same C. Every level of the
+ * recursion fits some level of the cache, without tuning to its size.
+ *
+ * C = A * B (or C += A * B if add is true), with the layout of
+ * kernel_mult. Has to be called by one thread of a parallel region
+ * (e.g. in a single construct), the others execute the tasks. */
+void recursive_mult(int m, int n, int k,
+                    const kernel_elem_t *a, size_t lda,
+                    const kernel_elem_t *b, size_t ldb,
+                    kernel_elem_t *c, size_t ldc, bool add);
+
+#endif /* RECURSIVE_H */
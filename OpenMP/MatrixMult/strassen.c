@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "strassen.h"
+
+/* Z = X + Y or Z = X - Y for m x n matrices */
+static void add(int m, int n, const kernel_elem_t *x, size_t ldx, const kernel_elem_t *y, size_t ldy,
+                kernel_elem_t *z, size_t ldz, bool subtract)
+{
+    int i, j;
+
+    for (i = 0; i < m; ++i) {
+        if (subtract) {
+            for (j = 0; j < n; ++j) {
+                z[i * ldz + j] = x[i * ldx + j] - y[i * ldy + j];
+            }
+        } else {
+            for (j = 0; j < n; ++j) {
+                z[i * ldz + j] = x[i * ldx + j] + y[i * ldy + j];
+            }
+        }
+    }
+}
+
+void strassen_mult(int m, int n, int k,
+                   const kernel_elem_t *a, size_t lda,
+                   const kernel_elem_t *b, size_t ldb,
+                   kernel_elem_t *c, size_t ldc, int cutoff)
+{
+    if (m <= cutoff || n <= cutoff || k <= cutoff) {
+        kernel_mult(m, n, k, a, lda, b, ldb, c, ldc, false);
+        return;
+    }
+
+    // Quadrants of the even part
+    int mh = m / 2, nh = n / 2, kh = k / 2;
+    const kernel_elem_t *a11 = a, *a12 = a + kh, *a21 = a + mh * lda, *a22 = a21 + kh;
+    const kernel_elem_t *b11 = b, *b12 = b + nh, *b21 = b + kh * ldb, *b22 = b21 + nh;
+    kernel_elem_t *c11 = c, *c12 = c + nh, *c21 = c + mh * ldc, *c22 = c21 + nh;
+
+    // Sums of quadrants of A (mh x kh) and B (kh x nh), and the 7 products (mh x nh)
+    size_t sa = (size_t) mh * kh, sb = (size_t) kh * nh, sp = (size_t) mh * nh;
+    kernel_elem_t *tmp = malloc((4 * sa + 4 * sb + 7 * sp) * sizeof(kernel_elem_t));
+    if (tmp == NULL) {
+        perror("Could not allocate memory for Strassen temporaries!");
+        exit(EXIT_FAILURE);
+    }
+    kernel_elem_t *s1 = tmp, *s2 = s1 + sa, *s3 = s2 + sa, *s4 = s3 + sa;
+    kernel_elem_t *t1 = s4 + sa, *t2 = t1 + sb, *t3 = t2 + sb, *t4 = t3 + sb;
+    kernel_elem_t *p1 = t4 + sb, *p2 = p1 + sp, *p3 = p2 + sp, *p4 = p3 + sp;
+    kernel_elem_t *p5 = p4 + sp, *p6 = p5 + sp, *p7 = p6 + sp;
+
+    add(mh, kh, a21, lda, a22, lda, s1, kh, false);     // S1 = A21 + A22
+    add(mh, kh, s1, kh, a11, lda, s2, kh, true);        // S2 = S1 - A11
+    add(mh, kh, a11, lda, a21, lda, s3, kh, true);      // S3 = A11 - A21
+    add(mh, kh, a12, lda, s2, kh, s4, kh, true);        // S4 = A12 - S2
+    add(kh, nh, b12, ldb, b11, ldb, t1, nh, true);      // T1 = B12 - B11
+    add(kh, nh, b22, ldb, t1, nh, t2, nh, true);        // T2 = B22 - T1
+    add(kh, nh, b22, ldb, b12, ldb, t3, nh, true);      // T3 = B22 - B12
+    add(kh, nh, t2, nh, b21, ldb, t4, nh, true);        // T4 = T2 - B21
+
+    #pragma omp task
+    strassen_mult(mh, nh, kh, a11, lda, b11, ldb, p1, nh, cutoff);  // P1 = A11 * B11
+    #pragma omp task
+    strassen_mult(mh, nh, kh, a12, lda, b21, ldb, p2, nh, cutoff);  // P2 = A12 * B21
+    #pragma omp task
+    strassen_mult(mh, nh, kh, s4, kh, b22, ldb, p3, nh, cutoff);    // P3 = S4 * B22
+    #pragma omp task
+    strassen_mult(mh, nh, kh, a22, lda, t4, nh, p4, nh, cutoff);    // P4 = A22 * T4
+    #pragma omp task
+    strassen_mult(mh, nh, kh, s1, kh, t1, nh, p5, nh, cutoff);      // P5 = S1 * T1
+    #pragma omp task
+    strassen_mult(mh, nh, kh, s2, kh, t2, nh, p6, nh, cutoff);      // P6 = S2 * T2
+    strassen_mult(mh, nh, kh, s3, kh, t3, nh, p7, nh, cutoff);      // P7 = S3 * T3
+    #pragma omp taskwait
+
+    add(mh, nh, p1, nh, p2, nh, c11, ldc, false);       // C11 = P1 + P2
+    add(mh, nh, p1, nh, p6, nh, p6, nh, false);         // U2 = P1 + P6
+    add(mh, nh, p6, nh, p7, nh, p7, nh, false);         // U3 = U2 + P7
+    add(mh, nh, p6, nh, p5, nh, p6, nh, false);         // U4 = U2 + P5
+    add(mh, nh, p6, nh, p3, nh, c12, ldc, false);       // C12 = U4 + P3
+    add(mh, nh, p7, nh, p4, nh, c21, ldc, true);        // C21 = U3 - P4
+    add(mh, nh, p7, nh, p5, nh, c22, ldc, false);       // C22 = U3 + P5
+    free(tmp);
+
+    // Peeled last column of A / row of B, last column and last row of C
+    if (k % 2) {
+        kernel_mult(2 * mh, 2 * nh, 1, a + 2 * kh, lda, b + 2 * kh * ldb, ldb, c, ldc, true);
+    }
+    if (n % 2) {
+        kernel_mult(2 * mh, 1, k, a, lda, b + 2 * nh, ldb, c + 2 * nh, ldc, false);
+    }
+    if (m % 2) {
+        kernel_mult(1, n, k, a + 2 * mh * lda, lda, b, ldb, c + 2 * mh * ldc, ldc, false);
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+#include "kernel.h"
+
+/* Strassen-Winograd multiplication: every level splits the operands into
+ * quadrants and needs 7 multiplications of them (run as OpenMP tasks) and
+ * 15 additions instead of 8 multiplications. Below the cutoff, i.e. once
+ * one of m, n, k is at most cutoff, kernel_mult is used.
+ *
+ * Odd dimensions are peeled: the even part is multiplied recursively and
+ * the last row / column / rank one update are added with kernel_mult, so
+ * any m x k times k x n product is supported without padding.
+ *
+ * C = A * B, with the layout of kernel_mult. Has to be called by one
+ * thread of a parallel region (e.g. in a single construct), the others
+ * execute the tasks. */
+void strassen_mult(int m, int n, int k,
+                   const kernel_elem_t *a, size_t lda,
+                   const kernel_elem_t *b, size_t ldb,
+                   kernel_elem_t *c, size_t ldc, int cutoff);
+
+#endif /* STRASSEN_H */
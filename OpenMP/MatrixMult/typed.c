@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kernel.h"
+#include "matfile.h"
+#include "textload.h"
+#include "typed.h"
+
+// Rows of R calculated by one call of the kernel
+#define TYPED_ROWS 64
+
+uint32_t typed_file_type(const char *path)
+{
+    matfile_t file;
+    uint32_t type;
+
+    if (!matfile_is_binary(path) || !matfile_open(path, &file)) {
+        return MATFILE_INT64;
+    }
+    type = file.hdr.elem_type;
+    matfile_close(&file);
+    return type;
+}
+
+/* Convert count int64 elements to the given type */
+static void convert(const int64_t *src, size_t count, uint32_t type, void *dst)
+{
+    size_t i;
+
+    switch (type) {
+    case MATFILE_INT32:
+        for (i = 0; i < count; ++i) {
+            ((int32_t *) dst)[i] = (int32_t) src[i];
+        }
+        break;
+    case MATFILE_FLOAT:
+        for (i = 0; i < count; ++i) {
+            ((float *) dst)[i] = (float) src[i];
+        }
+        break;
+    case MATFILE_DOUBLE:
+        for (i = 0; i < count; ++i) {
+            ((double *) dst)[i] = (double) src[i];
+        }
+        break;
+    default:
+        memcpy(dst, src, count * sizeof(int64_t));
+    }
+}
+
+bool typed_read(const char *path, typed_matrix_t *m, int t)
+{
+    size_t count;
+    int64_t *wide;
+
+    if (matfile_is_binary(path)) {
+        matfile_t file;
+        if (!matfile_open(path, &file)) {
+            return false;
+        }
+        m->rows = (int) file.hdr.rows;
+        m->cols = (int) file.hdr.cols;
+        m->data = malloc((size_t) m->rows * m->cols * matfile_elem_size(m->type) + 1);
+        if (m->data != NULL) {
+            matfile_load_block(&file, m->type, false, 0, m->rows, 0, m->cols, m->data, m->cols);
+        }
+        matfile_close(&file);
+        return m->data != NULL;
+    }
+
+    // Text files hold integers
+    if (!textload_matrix(path, false, t, &m->rows, &m->cols, &wide)) {
+        return false;
+    }
+    count = (size_t) m->rows * m->cols;
+    m->data = malloc(count * matfile_elem_size(m->type) + 1);
+    if (m->data != NULL) {
+        convert(wide, count, m->type, m->data);
+    }
+    free(wide);
+    return m->data != NULL;
+}
+
+bool typed_mult(const typed_matrix_t *a, const typed_matrix_t *b, typed_matrix_t *r)
+{
+    size_t size = matfile_elem_size(a->type);
+    int i;
+
+    if (a->cols != b->rows || a->type != b->type) {
+        return false;
+    }
+
+    r->rows = a->rows;
+    r->cols = b->cols;
+    r->type = a->type;
+    r->data = malloc((size_t) r->rows * r->cols * size + 1);
+    if (r->data == NULL) {
+        perror("Could not allocate memory for result matrix!");
+        exit(EXIT_FAILURE);
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (i = 0; i < r->rows; i += TYPED_ROWS) {
+        int rows = (r->rows - i < TYPED_ROWS) ? r->rows - i : TYPED_ROWS;
+        kernel_mult_type(a->type, rows, r->cols, a->cols,
+                         (const char *) a->data + (size_t) i * a->cols * size, a->cols,
+                         b->data, b->cols,
+                         (char *) r->data + (size_t) i * r->cols * size, r->cols, false);
+    }
+    return true;
+}
+
+bool typed_print(const typed_matrix_t *m, matwrite_mode mode, int fd, int t)
+{
+    size_t i, count = (size_t) m->rows * m->cols;
+    bool integer = (m->type == MATFILE_INT32 || m->type == MATFILE_INT64);
+    char line[400];
+    bool ok;
+
+    if (mode == MATWRITE_BINARY) {
+        return matwrite_binary(fd, m->type, m->data, m->rows, m->cols);
+    }
+
+    void *wide = malloc(count * 8 + 1);
+    if (wide == NULL) {
+        perror("Could not allocate memory!");
+        exit(EXIT_FAILURE);
+    }
+
+    if (integer) {
+        int64_t *w = wide, sum = 0;
+        for (i = 0; i < count; ++i) {
+            w[i] = (m->type == MATFILE_INT32) ? ((int32_t *) m->data)[i] : ((int64_t *) m->data)[i];
+            sum += w[i];
+        }
+        ok = (mode != MATWRITE_TEXT || matwrite_text_int64(fd, w, m->rows, m->cols, t));
+        snprintf(line, sizeof(line), "sum: %lld\n", (long long) sum);
+    } else {
+        double *w = wide, sum = 0.0;
+        for (i = 0; i < count; ++i) {
+            w[i] = (m->type == MATFILE_FLOAT) ? ((float *) m->data)[i] : ((double *) m->data)[i];
+            sum += w[i];
+        }
+        ok = (mode != MATWRITE_TEXT || matwrite_text_double(fd, w, m->rows, m->cols, t));
+        snprintf(line, sizeof(line), "sum: %lf\n", sum);
+    }
+
+    if (mode == MATWRITE_SUM) {
+        snprintf(line + strlen(line), sizeof(line) - strlen(line), "hash: %016llx\n",
+                 (unsigned long long) matwrite_hash(wide, count));
+    }
+    free(wide);
+    return ok && matwrite_str(fd, line);
+}
+
+void typed_free(typed_matrix_t *m)
+{
+    free(m->data);
+    m->data = NULL;
+}
@@ -0,0 +1,34 @@
+#ifndef TYPED_H
+#define TYPED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "matwrite.h"
+
+/* Matrices of int32, float or double elements (mmul_omp -e, or the element
+ * type of a binary A). They are multiplied at their natural width with the
+ * kernel generated for their type (kernel.h); the type is dispatched once
+ * per block of rows, not per element. int64 matrices take the usual path. */
+
+typedef struct {
+    int rows, cols;
+    uint32_t type;      // Element type, see matfile.h
+    void *data;
+} typed_matrix_t;
+
+/* Element type of a binary matrix file, MATFILE_INT64 for text files */
+uint32_t typed_file_type(const char *path);
+
+/* Read a binary or text matrix (parsed by t threads) converted to m->type */
+bool typed_read(const char *path, typed_matrix_t *m, int t);
+
+/* r = a * b, r is allocated. Returns false if the dimensions don't match. */
+bool typed_mult(const typed_matrix_t *a, const typed_matrix_t *b, typed_matrix_t *r);
+
+/* Write like print_matrix of mmul_omp: binary at the natural width, text and
+ * sum of the elements widened to int64 or double */
+bool typed_print(const typed_matrix_t *m, matwrite_mode mode, int fd, int t);
+
+void typed_free(typed_matrix_t *m);
+
+#endif /* TYPED_H */
@@ -0,0 +1,100 @@
+#!/bin/sh
+# Runs the kernel benchmarks of pmmul_opt, mmul_omp and mmul_mpi over all
+# combinations of SIZES and THREADS (RANKS, MPI_THREADS and MPI_MODES for MPI) and prints the results
+# as CSV or JSON (FORMAT) to stdout. Usually started by "make bench".
+#
+# Every program multiplies generated n x n operands in memory, runs WARMUPS
+# untimed and REPS timed multiplications and reports median, 95th percentile
+# and minimum of the kernel time and GFLOPS (double) / GOPS (int64).
+# The parallel efficiency is added here: relative to the run of the same
+# program and size with the fewest threads,
+#   efficiency = median_base * threads_base / (median * threads)
+
+SIZES=${SIZES:-"256 512 1024"}
+THREADS=${THREADS:-"1 2 4 8"}
+RANKS=${RANKS:-"2 3 5 9"}
+MPI_MODES=${MPI_MODES:-"rows summa pipeline"}
+MPI_THREADS=${MPI_THREADS:-1}
+WARMUPS=${WARMUPS:-1}
+REPS=${REPS:-5}
+FORMAT=${FORMAT:-csv}
+MPIRUN=${MPIRUN:-mpirun}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+# Columns of the rows, as defined for bench_report
+HEADER=$(sed -n 's/^#define BENCH_HEADER "\(.*\)"$/\1/p' "$ROOT/common/bench.h")
+if [ -z "$HEADER" ]; then
+    echo "BENCH_HEADER not found in $ROOT/common/bench.h" >&2
+    exit 1
+fi
+
+run() {
+    for n in $SIZES; do
+        for t in $THREADS; do
+            "$ROOT/pthreads/pmmul_opt" -b "$n" -w "$WARMUPS" -k "$REPS" "$t"
+        done
+        for t in $THREADS; do
+            "$ROOT/OpenMP/MatrixMult/mmul_omp" -b "$n" -w "$WARMUPS" -k "$REPS" "$t"
+        done
+        if [ -n "$RANKS" ]; then
+            for m in $MPI_MODES; do
+                for p in $RANKS; do
+                    for t in $MPI_THREADS; do
+                        $MPIRUN -np "$p" "$ROOT/MPI/MatrixMult/mmul_mpi" -m "$m" -t "$t" -b "$n" -w "$WARMUPS" -k "$REPS"
+                    done
+                done
+            done
+        fi
+    done
+}
+
+case $FORMAT in
+    csv|json) ;;
+    *) echo "unknown FORMAT $FORMAT, use csv or json" >&2; exit 1 ;;
+esac
+
+# Keep only the result rows, in case a program prints anything else
+{ echo "$HEADER"; run | grep -E '^(pmmul_opt|mmul_omp|mmul_mpi)[a-z_]*,'; } | awk -F, -v format="$FORMAT" '
+NR == 1 {
+    header = $0
+    ncols = split($0, name, ",")
+    next
+}
+{
+    rows++
+    for (i = 1; i <= NF; ++i) {
+        v[rows, i] = $i
+    }
+    key = $1 "," $3
+    if (!(key in base_threads) || $4 < base_threads[key]) {
+        base_threads[key] = $4
+        base_median[key] = $6
+    }
+}
+END {
+    if (format == "csv") {
+        print header ",efficiency"
+    } else {
+        print "["
+    }
+    for (r = 1; r <= rows; ++r) {
+        key = v[r, 1] "," v[r, 3]
+        eff = base_median[key] * base_threads[key] / (v[r, 6] * v[r, 4])
+        if (format == "csv") {
+            line = v[r, 1]
+            for (i = 2; i <= ncols; ++i) {
+                line = line "," v[r, i]
+            }
+            printf "%s,%.3f\n", line, eff
+        } else {
+            line = "  {\"" name[1] "\": \"" v[r, 1] "\", \"" name[2] "\": \"" v[r, 2] "\""
+            for (i = 3; i <= ncols; ++i) {
+                line = line ", \"" name[i] "\": " v[r, i]
+            }
+            printf "%s, \"efficiency\": %.3f}%s\n", line, eff, (r < rows) ? "," : ""
+        }
+    }
+    if (format == "json") {
+        print "]"
+    }
+}'
@@ -0,0 +1,149 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "affinity.h"
+
+int affinity_parse(const char *spec, int **cpus)
+{
+    int n = 0, cap = 16, first, last, c;
+    const char *p = spec;
+    char *end;
+
+    *cpus = malloc(cap * sizeof(int));
+    if (*cpus == NULL) {
+        return -1;
+    }
+
+    while (*p != '\0') {
+        first = (int) strtol(p, &end, 10);
+        if (end == p || first < 0) {
+            goto invalid;
+        }
+        last = first;
+        p = end;
+        if (*p == '-') {
+            ++p;
+            last = (int) strtol(p, &end, 10);
+            if (end == p || last < first) {
+                goto invalid;
+            }
+            p = end;
+        }
+
+        for (c = first; c <= last; ++c) {
+            if (n == cap) {
+                cap *= 2;
+                *cpus = realloc(*cpus, cap * sizeof(int));
+                if (*cpus == NULL) {
+                    return -1;
+                }
+            }
+            (*cpus)[n++] = c;
+        }
+
+        if (*p == ',') {
+            ++p;
+        } else if (*p != '\0') {
+            goto invalid;
+        }
+    }
+
+    if (n > 0) {
+        return n;
+    }
+
+invalid:
+    free(*cpus);
+    *cpus = NULL;
+    return -1;
+}
+
+int affinity_default(int **cpus)
+{
+    cpu_set_t set;
+    int c, n = 0;
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        CPU_ZERO(&set);
+        CPU_SET(0, &set);
+    }
+
+    *cpus = malloc(CPU_COUNT(&set) * sizeof(int));
+    if (*cpus == NULL) {
+        return -1;
+    }
+    for (c = 0; c < CPU_SETSIZE; ++c) {
+        if (CPU_ISSET(c, &set)) {
+            (*cpus)[n++] = c;
+        }
+    }
+    return n;
+}
+
+bool affinity_pin(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        fprintf(stderr, "Could not pin thread to CPU %d\n", cpu);
+        return false;
+    }
+    return true;
+}
+
+struct affinity_mask {
+    cpu_set_t set;
+};
+
+affinity_mask *affinity_save(void)
+{
+    affinity_mask *mask = malloc(sizeof(affinity_mask));
+
+    if (mask != NULL && pthread_getaffinity_np(pthread_self(), sizeof(mask->set), &mask->set) != 0) {
+        free(mask);
+        mask = NULL;
+    }
+    return mask;
+}
+
+bool affinity_restore(affinity_mask *mask)
+{
+    bool ok;
+
+    if (mask == NULL) {
+        return false;
+    }
+    ok = pthread_setaffinity_np(pthread_self(), sizeof(mask->set), &mask->set) == 0;
+    if (!ok) {
+        fputs("Could not restore the CPUs of the thread\n", stderr);
+    }
+    free(mask);
+    return ok;
+}
+
+int affinity_node_of_cpu(int cpu)
+{
+    char path[64];
+    DIR *dir;
+    struct dirent *entry;
+    int node = 0;
+
+    // The directory of a CPU contains a link "node<N>" to its node
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    if ((dir = opendir(path)) == NULL) {
+        return 0;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && sscanf(entry->d_name + 4, "%d", &node) == 1) {
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
@@ -0,0 +1,32 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stdbool.h>
+
+/* Thread pinning and NUMA topology (Linux, read from sysfs).
+ *
+ * An affinity map is a list of CPU numbers; thread i is pinned to
+ * cpus[i % ncpus]. */
+
+/* Parse a CPU list like "0-7,16-23" into a newly allocated array.
+ * Returns the number of CPUs or -1 if the list is invalid. */
+int affinity_parse(const char *spec, int **cpus);
+
+/* The CPUs the process is allowed to run on, as newly allocated array */
+int affinity_default(int **cpus);
+
+/* Pin the calling thread to one CPU */
+bool affinity_pin(int cpu);
+
+/* The CPUs the calling thread may run on, saved before pinning it */
+typedef struct affinity_mask affinity_mask;
+
+affinity_mask *affinity_save(void);
+
+/* Let the calling thread run on the saved CPUs again, frees mask */
+bool affinity_restore(affinity_mask *mask);
+
+/* NUMA node of a CPU, 0 if the topology is unknown */
+int affinity_node_of_cpu(int cpu);
+
+#endif /* AFFINITY_H */
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bench.h"
+
+double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.0E+9;
+}
+
+// xorshift64*, good enough for test operands
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+void bench_fill_int64(int64_t *data, size_t count, int64_t range, uint64_t seed)
+{
+    uint64_t state = seed | 1;
+    size_t i;
+
+    for (i = 0; i < count; ++i) {
+        data[i] = (int64_t) (next_random(&state) % (uint64_t) (2 * range + 1)) - range;
+    }
+}
+
+void bench_fill_double(double *data, size_t count, double range, uint64_t seed)
+{
+    uint64_t state = seed | 1;
+    size_t i;
+
+    for (i = 0; i < count; ++i) {
+        data[i] = ((next_random(&state) >> 11) * 0x1.0p-53 * 2.0 - 1.0) * range;
+    }
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+void bench_report(const char *program, const char *type, int n, int threads, double *times, int reps)
+{
+    double median, p95, ops = 2.0 * n * n * (double) n;
+    int i95;
+
+    qsort(times, reps, sizeof(double), compare_double);
+    median = (reps % 2) ? times[reps / 2] : (times[reps / 2 - 1] + times[reps / 2]) / 2;
+
+    // Nearest rank: the smallest timing not exceeded by 95% of the runs
+    i95 = (95 * reps + 99) / 100 - 1;
+    p95 = times[i95 < 0 ? 0 : i95];
+
+    printf("%s,%s,%d,%d,%d,%.6f,%.6f,%.6f,%.3f\n", program, type, n, threads, reps,
+           median, p95, times[0], ops / median / 1.0E+9);
+    fflush(stdout);
+}
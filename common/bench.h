@@ -0,0 +1,37 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Kernel benchmarks of the matrix multipliers.
+ *
+ * In benchmark mode (-b) the programs multiply synthetic n x n operands
+ * generated in memory, run the kernel a number of times without timing
+ * (warmups) and then time every repetition on its own. The timings are
+ * reported as one CSV row per run (see BENCH_HEADER); bench/bench.sh
+ * collects the rows of a whole sweep. */
+
+typedef struct {
+    int size;       // n of the n x n operands, 0 if not benchmarking
+    int warmups;    // Untimed runs before the measurement
+    int reps;       // Timed runs
+} bench_options;
+
+#define BENCH_DEFAULTS { 0, 1, 5 }
+
+// Columns of bench_report. gops is GFLOPS for double and GOPS for int64.
+#define BENCH_HEADER "program,type,n,threads,reps,median_s,p95_s,min_s,gops"
+
+/* Wall clock time in seconds (CLOCK_MONOTONIC) */
+double bench_now(void);
+
+/* Fill count elements with reproducible pseudo random values in [-range, range] */
+void bench_fill_int64(int64_t *data, size_t count, int64_t range, uint64_t seed);
+void bench_fill_double(double *data, size_t count, double range, uint64_t seed);
+
+/* Print the statistics of the reps timings (seconds, reordered) of an
+ * n x n x n multiplication with threads threads as CSV row to stdout */
+void bench_report(const char *program, const char *type, int n, int threads, double *times, int reps);
+
+#endif /* BENCH_H */
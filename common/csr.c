@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <string.h>
+#include "csr.h"
+
+size_t csr_count(const int64_t *data, size_t count)
+{
+    size_t i, nnz = 0;
+
+    for (i = 0; i < count; ++i) {
+        nnz += (data[i] != 0);
+    }
+    return nnz;
+}
+
+bool csr_is_sparse(size_t nnz, int rows, int cols)
+{
+    return (double) nnz < CSR_DENSITY * (double) rows * (double) cols;
+}
+
+bool csr_from_dense(csr_matrix *m, const int64_t *data, int rows, int cols, bool transposed, size_t nnz)
+{
+    size_t *next;
+    int i, j;
+
+    m->rows = rows;
+    m->cols = cols;
+    m->nnz = nnz;
+    m->row_ptr = calloc((size_t) rows + 1, sizeof(size_t));
+    m->col = malloc((nnz + 1) * sizeof(int));
+    m->val = malloc((nnz + 1) * sizeof(int64_t));
+    if (m->row_ptr == NULL || m->col == NULL || m->val == NULL) {
+        csr_free(m);
+        return false;
+    }
+
+    if (!transposed) {
+        for (i = 0; i < rows; ++i) {
+            const int64_t *di = &data[(size_t) i * cols];
+            size_t p = m->row_ptr[i];
+            for (j = 0; j < cols; ++j) {
+                if (di[j] != 0) {
+                    m->col[p] = j;
+                    m->val[p++] = di[j];
+                }
+            }
+            m->row_ptr[i + 1] = p;
+        }
+        return true;
+    }
+
+    // Column by column: count the elements of every row first, then fill the rows in column order
+    for (j = 0; j < cols; ++j) {
+        const int64_t *dj = &data[(size_t) j * rows];
+        for (i = 0; i < rows; ++i) {
+            m->row_ptr[i + 1] += (dj[i] != 0);
+        }
+    }
+    for (i = 0; i < rows; ++i) {
+        m->row_ptr[i + 1] += m->row_ptr[i];
+    }
+
+    next = malloc(((size_t) rows + 1) * sizeof(size_t));
+    if (next == NULL) {
+        csr_free(m);
+        return false;
+    }
+    memcpy(next, m->row_ptr, ((size_t) rows + 1) * sizeof(size_t));
+    for (j = 0; j < cols; ++j) {
+        const int64_t *dj = &data[(size_t) j * rows];
+        for (i = 0; i < rows; ++i) {
+            if (dj[i] != 0) {
+                m->col[next[i]] = j;
+                m->val[next[i]++] = dj[i];
+            }
+        }
+    }
+    free(next);
+    return true;
+}
+
+void csr_to_dense(const csr_matrix *m, int64_t *data, bool transposed)
+{
+    size_t p;
+    int i;
+
+    memset(data, 0, (size_t) m->rows * m->cols * sizeof(int64_t));
+    for (i = 0; i < m->rows; ++i) {
+        for (p = m->row_ptr[i]; p < m->row_ptr[i + 1]; ++p) {
+            if (transposed) {
+                data[(size_t) m->col[p] * m->rows + i] = m->val[p];
+            } else {
+                data[(size_t) i * m->cols + m->col[p]] = m->val[p];
+            }
+        }
+    }
+}
+
+void csr_free(csr_matrix *m)
+{
+    free(m->row_ptr);
+    free(m->col);
+    free(m->val);
+    m->row_ptr = NULL;
+    m->col = NULL;
+    m->val = NULL;
+}
+
+uint64_t csr_row_dot(const csr_matrix *m, int i, const uint64_t *x)
+{
+    uint64_t sum = 0;
+    size_t p;
+
+    for (p = m->row_ptr[i]; p < m->row_ptr[i + 1]; ++p) {
+        sum += (uint64_t) m->val[p] * x[m->col[p]];
+    }
+    return sum;
+}
+
+void csr_spgemm_rows(const csr_matrix *a, const csr_matrix *b, int i0, int i1, int64_t *r, size_t ldr)
+{
+    size_t p, q;
+    int i;
+
+    for (i = i0; i < i1; ++i) {
+        uint64_t *ri = (uint64_t *) &r[(size_t) i * ldr];
+        for (p = a->row_ptr[i]; p < a->row_ptr[i + 1]; ++p) {
+            uint64_t aik = (uint64_t) a->val[p];
+            int k = a->col[p];
+            for (q = b->row_ptr[k]; q < b->row_ptr[k + 1]; ++q) {
+                ri[b->col[q]] += aik * (uint64_t) b->val[q];
+            }
+        }
+    }
+}
+
+void csr_spmm_rows(const csr_matrix *a, const int64_t *b, size_t ldb, int n,
+                   int i0, int i1, int64_t *r, size_t ldr)
+{
+    size_t p;
+    int i, j;
+
+    for (i = i0; i < i1; ++i) {
+        uint64_t *ri = (uint64_t *) &r[(size_t) i * ldr];
+        for (p = a->row_ptr[i]; p < a->row_ptr[i + 1]; ++p) {
+            uint64_t aik = (uint64_t) a->val[p];
+            const uint64_t *bk = (const uint64_t *) &b[(size_t) a->col[p] * ldb];
+            for (j = 0; j < n; ++j) {
+                ri[j] += aik * bk[j];
+            }
+        }
+    }
+}
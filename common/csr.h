@@ -0,0 +1,60 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Compressed sparse row (CSR) matrices and the sparse kernels of the
+ * pthreads and OpenMP multipliers.
+ *
+ * Operands with fewer than CSR_DENSITY nonzero elements are converted to
+ * CSR after loading and the dense elements are freed. The density is only
+ * known after the dense load, so this saves computation, not peak memory. If A is sparse, R is
+ * calculated row by row (Gustavson): row i of R accumulates a(i, k) times
+ * row k of B for the nonzero elements of row i of A, with B sparse
+ * (SpGEMM) or dense (SpMM). The result is dense anyway, so its row serves
+ * as the dense accumulator. The kernels calculate a range of rows, the
+ * programs split the rows onto their threads.
+ *
+ * All sums are calculated modulo 2^64 like the dense kernels, so the
+ * results are identical. */
+
+// Below this share of nonzero elements a matrix is stored and multiplied sparse
+#define CSR_DENSITY 0.02
+
+typedef struct {
+    int rows, cols;
+    size_t nnz;
+    size_t *row_ptr;    // Row i is [row_ptr[i], row_ptr[i + 1]) of col and val
+    int *col;           // Column of every element, increasing within a row
+    int64_t *val;
+} csr_matrix;
+
+/* Number of nonzero elements of count elements */
+size_t csr_count(const int64_t *data, size_t count);
+
+/* True if a rows x cols matrix with nnz nonzero elements is stored sparse */
+bool csr_is_sparse(size_t nnz, int rows, int cols);
+
+/* Build the CSR form of a dense rows x cols matrix with nnz nonzero elements,
+ * stored row major or, if transposed is set, column by column. Returns false
+ * if the memory can't be allocated. */
+bool csr_from_dense(csr_matrix *m, const int64_t *data, int rows, int cols, bool transposed, size_t nnz);
+
+/* Write all elements to data, row major or (transposed) column by column */
+void csr_to_dense(const csr_matrix *m, int64_t *data, bool transposed);
+
+void csr_free(csr_matrix *m);
+
+/* Sum of row i times x, modulo 2^64 */
+uint64_t csr_row_dot(const csr_matrix *m, int i, const uint64_t *x);
+
+/* Add the rows [i0, i1) of A * B to R, for sparse A and B (SpGEMM) or sparse A
+ * and dense, row major B with leading dimension ldb (SpMM). R is dense and row
+ * major with leading dimension ldr. */
+void csr_spgemm_rows(const csr_matrix *a, const csr_matrix *b, int i0, int i1, int64_t *r, size_t ldr);
+void csr_spmm_rows(const csr_matrix *a, const int64_t *b, size_t ldb, int n,
+                   int i0, int i1, int64_t *r, size_t ldr);
+
+#endif /* CSR_H */
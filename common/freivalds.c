@@ -0,0 +1,58 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "freivalds.h"
+
+int freivalds_parse(const char *arg)
+{
+    char *end;
+    long trials;
+
+    if (arg == NULL) {
+        return FREIVALDS_TRIALS;
+    }
+    trials = strtol(arg, &end, 0);
+    if (end == arg || *end != '\0' || trials < 1 || trials > 1000) {
+        return -1;
+    }
+    return (int) trials;
+}
+
+uint64_t freivalds_seed(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000007ULL ^ (uint64_t) ts.tv_nsec ^ ((uint64_t) getpid() << 32);
+}
+
+// splitmix64 of the position, so the elements don't depend on each other
+int freivalds_x(uint64_t seed, int trial, uint64_t i)
+{
+    uint64_t z = seed + ((uint64_t) trial << 40) + i * 0x9e3779b97f4a7c15ULL;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (int) ((z ^ (z >> 31)) >> 63);
+}
+
+/* The product and the three matrix-vector products each sum up n terms, each
+ * with an error of at most about n * DBL_EPSILON / 2 relative to magnitude */
+double freivalds_tolerance(uint64_t n, double magnitude)
+{
+    return 4.0 * (double) (n + 2) * DBL_EPSILON * magnitude;
+}
+
+bool freivalds_report(int trials, int failed)
+{
+    if (failed > 0) {
+        fprintf(stderr, "Verification FAILED: %d of %d trials found a wrong result\n", failed, trials);
+        return false;
+    }
+    fprintf(stderr, "Verification passed: %d trials, probability of an undetected error <= %.3g\n",
+            trials, ldexp(1.0, -trials));
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef FREIVALDS_H
+#define FREIVALDS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Freivalds' probabilistic check of a product R = A * B (--verify).
+ *
+ * A trial multiplies with a random vector x of zeros and ones and compares
+ * A * (B * x) with R * x, which costs three matrix-vector products instead
+ * of another multiplication. If R is wrong, a trial misses that with a
+ * probability of at most 1/2, so k trials leave at most 2^-k. The programs
+ * calculate the products themselves, split like their kernels; this file
+ * provides the vectors, the tolerance for doubles and the report.
+ *
+ * Integer results are compared exactly, modulo 2^64 like the multipliers
+ * calculate them (the bound holds there too, as x only holds 0 and 1).
+ * Doubles are compared with a tolerance for the rounding errors, so the
+ * bound applies to errors larger than that. */
+
+#define FREIVALDS_TRIALS 20
+
+/* Number of trials from the argument of --verify (FREIVALDS_TRIALS if it
+ * is NULL), -1 if it is invalid */
+int freivalds_parse(const char *arg);
+
+/* Seed of the vectors, different for every run */
+uint64_t freivalds_seed(void);
+
+/* Element i of the vector of a trial, 0 or 1. Every thread or process can
+ * generate the elements it needs on its own. */
+int freivalds_x(uint64_t seed, int trial, uint64_t i);
+
+/* Largest accepted difference of an element of A * (B * x) and R * x for
+ * doubles with inner dimension n. magnitude is the same element of
+ * |A| * (|B| * x) + |R| * x. */
+double freivalds_tolerance(uint64_t n, double magnitude);
+
+/* Print the outcome to stderr, returns true if no trial failed */
+bool freivalds_report(int trials, int failed);
+
+#endif /* FREIVALDS_H */
@@ -0,0 +1,172 @@
+/**
+ *  @file matconv.c
+ *  @brief Convert matrices between the text and the binary format
+ *
+ *  The text format is the one used by pthreads/matrix.txt: the number of rows
+ *  and columns on the first two lines followed by the tab separated elements.
+ *  The binary format is described in matfile.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "matfile.h"
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-t] [-e int32|int64|float|double] <text file> <binary file>\n", name);
+    fprintf(stderr, "       %s -x <binary file> <text file>\n", name);
+    fprintf(stderr, "  -t  store the matrix transposed (column by column)\n");
+    fprintf(stderr, "  -e  element type of the binary file (default int64)\n");
+    fprintf(stderr, "  -x  export a binary matrix as text\n");
+}
+
+static bool text_to_binary(const char *in, const char *out, uint32_t type, bool transposed)
+{
+    FILE *fp;
+    int rows, cols, i, j;
+    size_t idx, size = matfile_elem_size(type);
+    long long x;
+    double d;
+    bool ok;
+
+    if ((fp = fopen(in, "r")) == NULL) {
+        perror("Can't open file!");
+        return false;
+    }
+
+    if (fscanf(fp, "%d", &rows) != 1 || fscanf(fp, "%d", &cols) != 1 || rows < 0 || cols < 0) {
+        fprintf(stderr, "%s: invalid matrix dimensions\n", in);
+        fclose(fp);
+        return false;
+    }
+
+    char *data = calloc((size_t) rows * cols, size);
+    if (data == NULL) {
+        perror("Could not allocate memory for matrix!");
+        fclose(fp);
+        return false;
+    }
+
+    for (i = 0; i < rows; ++i) {
+        for (j = 0; j < cols; ++j) {
+            idx = transposed ? (size_t) j * rows + i : (size_t) i * cols + j;
+            if (type == MATFILE_FLOAT || type == MATFILE_DOUBLE) {
+                if (fscanf(fp, "%lf", &d) != 1) {
+                    goto truncated;
+                }
+                if (type == MATFILE_FLOAT) {
+                    ((float *) data)[idx] = (float) d;
+                } else {
+                    ((double *) data)[idx] = d;
+                }
+            } else {
+                if (fscanf(fp, "%lld", &x) != 1) {
+                    goto truncated;
+                }
+                if (type == MATFILE_INT32) {
+                    ((int32_t *) data)[idx] = (int32_t) x;
+                } else {
+                    ((int64_t *) data)[idx] = x;
+                }
+            }
+        }
+    }
+    fclose(fp);
+
+    ok = matfile_write(out, type, rows, cols, transposed ? MATFILE_TRANSPOSED : 0, data);
+    free(data);
+    return ok;
+
+truncated:
+    fprintf(stderr, "%s: matrix is truncated\n", in);
+    fclose(fp);
+    free(data);
+    return false;
+}
+
+static bool binary_to_text(const char *in, const char *out)
+{
+    matfile_t mf;
+    FILE *fp;
+    uint64_t i, j;
+    bool integer;
+
+    if (!matfile_open(in, &mf)) {
+        return false;
+    }
+
+    if ((fp = fopen(out, "w")) == NULL) {
+        perror("Could not create file!");
+        matfile_close(&mf);
+        return false;
+    }
+
+    integer = mf.hdr.elem_type == MATFILE_INT32 || mf.hdr.elem_type == MATFILE_INT64;
+    int64_t *irow = malloc(mf.hdr.cols * sizeof(int64_t));
+    double *drow = malloc(mf.hdr.cols * sizeof(double));
+    if (irow == NULL || drow == NULL) {
+        perror("Could not allocate memory!");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(fp, "%llu\n%llu\n", (unsigned long long) mf.hdr.rows, (unsigned long long) mf.hdr.cols);
+    for (i = 0; i < mf.hdr.rows; ++i) {
+        if (integer) {
+            matfile_load_block(&mf, MATFILE_INT64, false, i, i + 1, 0, mf.hdr.cols, irow, mf.hdr.cols);
+        } else {
+            matfile_load_block(&mf, MATFILE_DOUBLE, false, i, i + 1, 0, mf.hdr.cols, drow, mf.hdr.cols);
+        }
+        for (j = 0; j < mf.hdr.cols; ++j) {
+            if (integer) {
+                fprintf(fp, "%lld\t", (long long) irow[j]);
+            } else {
+                fprintf(fp, "%lf\t", drow[j]);
+            }
+        }
+        fprintf(fp, "\n");
+    }
+
+    free(irow);
+    free(drow);
+    matfile_close(&mf);
+    return fclose(fp) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    bool transposed = false, export = false;
+    uint32_t type = MATFILE_INT64;
+
+    while ((opt = getopt(argc, argv, "te:x")) != -1) {
+        switch (opt) {
+        case 't':
+            transposed = true;
+            break;
+        case 'e':
+            if ((type = matfile_type_from_name(optarg)) == 0) {
+                fprintf(stderr, "Unknown element type %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'x':
+            export = true;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (export) {
+        return binary_to_text(argv[optind], argv[optind + 1]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    return text_to_binary(argv[optind], argv[optind + 1], type, transposed) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
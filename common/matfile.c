@@ -0,0 +1,222 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "matfile.h"
+
+_Static_assert(sizeof(matfile_header) == 64, "matfile header must be 64 bytes");
+
+size_t matfile_elem_size(uint32_t elem_type)
+{
+    switch (elem_type) {
+    case MATFILE_INT32:  return sizeof(int32_t);
+    case MATFILE_INT64:  return sizeof(int64_t);
+    case MATFILE_FLOAT:  return sizeof(float);
+    case MATFILE_DOUBLE: return sizeof(double);
+    default:             return 0;
+    }
+}
+
+static const char *type_names[] = { NULL, "int32", "int64", "float", "double" };
+
+const char *matfile_type_name(uint32_t elem_type)
+{
+    if (matfile_elem_size(elem_type) == 0) {
+        return "unknown";
+    }
+    return type_names[elem_type];
+}
+
+uint32_t matfile_type_from_name(const char *name)
+{
+    uint32_t t;
+
+    for (t = MATFILE_INT32; t <= MATFILE_DOUBLE; ++t) {
+        if (strcmp(name, type_names[t]) == 0) {
+            return t;
+        }
+    }
+    return 0;
+}
+
+bool matfile_is_binary(const char *path)
+{
+    char magic[8];
+    FILE *fp;
+    bool binary;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        return false;
+    }
+    binary = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, MATFILE_MAGIC, sizeof(magic)) == 0;
+    fclose(fp);
+    return binary;
+}
+
+bool matfile_open(const char *path, matfile_t *mf)
+{
+    int fd;
+    struct stat st;
+    size_t size;
+
+    memset(mf, 0, sizeof(matfile_t));
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        perror("Can't open file!");
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(matfile_header)) {
+        fprintf(stderr, "%s: not a binary matrix\n", path);
+        close(fd);
+        return false;
+    }
+
+    mf->map_len = st.st_size;
+    mf->map = mmap(NULL, mf->map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mf->map == MAP_FAILED) {
+        perror("Can't map file!");
+        mf->map = NULL;
+        return false;
+    }
+
+    /* The elements have to start behind the header, aligned to their size, and
+     * fit into the file. Compared by division, so huge rows and cols in a
+     * corrupt header can't overflow rows * cols * size. The programs index
+     * rows and cols with int. */
+    memcpy(&mf->hdr, mf->map, sizeof(matfile_header));
+    size = matfile_elem_size(mf->hdr.elem_type);
+    if (memcmp(mf->hdr.magic, MATFILE_MAGIC, sizeof(mf->hdr.magic)) != 0
+        || mf->hdr.version != MATFILE_VERSION || size == 0
+        || mf->hdr.data_offset < sizeof(matfile_header) || mf->hdr.data_offset % size != 0
+        || mf->hdr.data_offset > mf->map_len
+        || mf->hdr.rows > INT_MAX || mf->hdr.cols > INT_MAX
+        || (mf->hdr.rows != 0 && mf->hdr.cols > (mf->map_len - mf->hdr.data_offset) / size / mf->hdr.rows)) {
+        fprintf(stderr, "%s: invalid or truncated binary matrix\n", path);
+        matfile_close(mf);
+        return false;
+    }
+
+    mf->data = (char *) mf->map + mf->hdr.data_offset;
+    return true;
+}
+
+void matfile_close(matfile_t *mf)
+{
+    if (mf->map != NULL) {
+        munmap(mf->map, mf->map_len);
+    }
+    memset(mf, 0, sizeof(matfile_t));
+}
+
+bool matfile_matches(const matfile_t *mf, uint32_t elem_type, bool transposed)
+{
+    return mf->hdr.elem_type == elem_type && ((mf->hdr.flags & MATFILE_TRANSPOSED) != 0) == transposed;
+}
+
+/* Element idx of the mapped data as integer or floating point value */
+static int64_t get_int(const matfile_t *mf, size_t idx)
+{
+    switch (mf->hdr.elem_type) {
+    case MATFILE_INT32: return ((const int32_t *) mf->data)[idx];
+    case MATFILE_INT64: return ((const int64_t *) mf->data)[idx];
+    case MATFILE_FLOAT: return (int64_t) ((const float *) mf->data)[idx];
+    default:            return (int64_t) ((const double *) mf->data)[idx];
+    }
+}
+
+static double get_double(const matfile_t *mf, size_t idx)
+{
+    switch (mf->hdr.elem_type) {
+    case MATFILE_INT32: return ((const int32_t *) mf->data)[idx];
+    case MATFILE_INT64: return (double) ((const int64_t *) mf->data)[idx];
+    case MATFILE_FLOAT: return ((const float *) mf->data)[idx];
+    default:            return ((const double *) mf->data)[idx];
+    }
+}
+
+void matfile_load_block(const matfile_t *mf, uint32_t elem_type, bool transposed,
+                        uint64_t i0, uint64_t i1, uint64_t j0, uint64_t j1,
+                        void *dst, size_t ld)
+{
+    uint64_t i, j;
+    size_t src, out;
+    size_t size = matfile_elem_size(elem_type);
+    bool src_transposed = (mf->hdr.flags & MATFILE_TRANSPOSED) != 0;
+
+    // Same type and layout: copy whole lines
+    if (elem_type == mf->hdr.elem_type && src_transposed == transposed) {
+        if (!transposed) {
+            for (i = i0; i < i1; ++i) {
+                memcpy((char *) dst + (i - i0) * ld * size,
+                       (const char *) mf->data + (i * mf->hdr.cols + j0) * size, (j1 - j0) * size);
+            }
+        } else {
+            for (j = j0; j < j1; ++j) {
+                memcpy((char *) dst + (j - j0) * ld * size,
+                       (const char *) mf->data + (j * mf->hdr.rows + i0) * size, (i1 - i0) * size);
+            }
+        }
+        return;
+    }
+
+    for (i = i0; i < i1; ++i) {
+        for (j = j0; j < j1; ++j) {
+            src = src_transposed ? j * mf->hdr.rows + i : i * mf->hdr.cols + j;
+            out = transposed ? (j - j0) * ld + (i - i0) : (i - i0) * ld + (j - j0);
+
+            switch (elem_type) {
+            case MATFILE_INT32:  ((int32_t *) dst)[out] = (int32_t) get_int(mf, src); break;
+            case MATFILE_INT64:  ((int64_t *) dst)[out] = get_int(mf, src); break;
+            case MATFILE_FLOAT:  ((float *) dst)[out] = (float) get_double(mf, src); break;
+            case MATFILE_DOUBLE: ((double *) dst)[out] = get_double(mf, src); break;
+            }
+        }
+    }
+}
+
+void matfile_init_header(matfile_header *hdr, uint32_t elem_type, uint64_t rows, uint64_t cols, uint32_t flags)
+{
+    memset(hdr, 0, sizeof(matfile_header));
+    memcpy(hdr->magic, MATFILE_MAGIC, sizeof(hdr->magic));
+    hdr->version = MATFILE_VERSION;
+    hdr->elem_type = elem_type;
+    hdr->rows = rows;
+    hdr->cols = cols;
+    hdr->alignment = MATFILE_ALIGNMENT;
+    hdr->data_offset = ((sizeof(matfile_header) + MATFILE_ALIGNMENT - 1) / MATFILE_ALIGNMENT) * MATFILE_ALIGNMENT;
+    hdr->flags = flags;
+}
+
+bool matfile_write(const char *path, uint32_t elem_type, uint64_t rows, uint64_t cols,
+                   uint32_t flags, const void *data)
+{
+    matfile_header hdr;
+    char pad[MATFILE_ALIGNMENT] = { 0 };
+    size_t count = rows * cols;
+    FILE *fp;
+    bool ok;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+        perror("Could not create file!");
+        return false;
+    }
+
+    matfile_init_header(&hdr, elem_type, rows, cols, flags);
+    ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+         && fwrite(pad, 1, hdr.data_offset - sizeof(hdr), fp) == hdr.data_offset - sizeof(hdr)
+         && fwrite(data, matfile_elem_size(elem_type), count, fp) == count;
+
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        perror("Could not write file!");
+    }
+    return ok;
+}
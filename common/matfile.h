@@ -0,0 +1,83 @@
+#ifndef MATFILE_H
+#define MATFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Binary matrix container used by all matrix multipliers.
+ *
+ * A file consists of a fixed 64 byte header followed (at data_offset,
+ * a multiple of alignment) by rows * cols elements in host byte order.
+ * The elements are stored row by row, or column by column if the
+ * MATFILE_TRANSPOSED flag is set. rows and cols always describe the
+ * logical (not transposed) matrix.
+ *
+ * Files are memory mapped, so a program whose layout matches the file
+ * uses the elements in place without reading or copying them. */
+
+#define MATFILE_MAGIC "PPMATRIX"
+#define MATFILE_VERSION 1
+#define MATFILE_ALIGNMENT 64
+
+// Element types
+#define MATFILE_INT32  1
+#define MATFILE_INT64  2
+#define MATFILE_FLOAT  3
+#define MATFILE_DOUBLE 4
+
+// Flags
+#define MATFILE_TRANSPOSED 0x1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t elem_type;
+    uint64_t rows, cols;
+    uint64_t data_offset;
+    uint32_t alignment;
+    uint32_t flags;
+    uint8_t reserved[16];
+} matfile_header;
+
+typedef struct {
+    matfile_header hdr;
+    void *map;          // Whole file, NULL if nothing is mapped
+    size_t map_len;
+    void *data;         // First element, points into map
+} matfile_t;
+
+/* Size of one element of the given type, 0 for unknown types */
+size_t matfile_elem_size(uint32_t elem_type);
+
+/* Name ("int32", "int64", "float", "double") and type of an element type */
+const char *matfile_type_name(uint32_t elem_type);
+uint32_t matfile_type_from_name(const char *name);
+
+/* True if the file starts with the magic of a binary matrix */
+bool matfile_is_binary(const char *path);
+
+/* Map a binary matrix. The mapping is private and writable: writes never
+ * reach the file and only copy the pages they touch. */
+bool matfile_open(const char *path, matfile_t *mf);
+void matfile_close(matfile_t *mf);
+
+/* True if the elements can be used in place as a row major matrix of the
+ * given type (or a transposed one if transposed is set). */
+bool matfile_matches(const matfile_t *mf, uint32_t elem_type, bool transposed);
+
+/* Copy the logical block [i0, i1) x [j0, j1) into dst, converting the
+ * elements to elem_type. dst is row major with leading dimension ld, or
+ * holds the transposed block (column by column) if transposed is set. */
+void matfile_load_block(const matfile_t *mf, uint32_t elem_type, bool transposed,
+                        uint64_t i0, uint64_t i1, uint64_t j0, uint64_t j1,
+                        void *dst, size_t ld);
+
+/* Fill in a header for a rows x cols matrix with the default alignment */
+void matfile_init_header(matfile_header *hdr, uint32_t elem_type, uint64_t rows, uint64_t cols, uint32_t flags);
+
+/* Write a complete matrix, data is stored as described by flags */
+bool matfile_write(const char *path, uint32_t elem_type, uint64_t rows, uint64_t cols,
+                   uint32_t flags, const void *data);
+
+#endif /* MATFILE_H */
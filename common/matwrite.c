@@ -0,0 +1,268 @@
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "matfile.h"
+#include "matwrite.h"
+
+// Amount of text a thread formats before it is written
+#define BLOCK_BYTES (4 << 20)
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+bool matwrite_parse_mode(const char *name, matwrite_mode *mode)
+{
+    if (strcmp(name, "text") == 0) {
+        *mode = MATWRITE_TEXT;
+    } else if (strcmp(name, "binary") == 0) {
+        *mode = MATWRITE_BINARY;
+    } else if (strcmp(name, "sum") == 0) {
+        *mode = MATWRITE_SUM;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/* Format v with at least min_digits digits (zero padded) */
+static size_t format_uint(char *buf, uint64_t v, int min_digits)
+{
+    char tmp[MATWRITE_MAX_INT];
+    char *p = tmp + sizeof(tmp);
+    size_t len;
+
+    while (v >= 100) {
+        p -= 2;
+        memcpy(p, &digit_pairs[(v % 100) * 2], 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, &digit_pairs[v * 2], 2);
+    } else {
+        *--p = (char) ('0' + v);
+    }
+    while (tmp + sizeof(tmp) - p < min_digits) {
+        *--p = '0';
+    }
+
+    len = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, len);
+    return len;
+}
+
+size_t matwrite_format_int(char *buf, int64_t v)
+{
+    if (v < 0) {
+        *buf = '-';
+        return 1 + format_uint(buf + 1, (uint64_t) 0 - (uint64_t) v, 1);
+    }
+    return format_uint(buf, (uint64_t) v, 1);
+}
+
+size_t matwrite_format_double(char *buf, double v)
+{
+    double a = fabs(v), scaled, r, e;
+    uint64_t u;
+    size_t len = 0;
+
+    // Fast path: round |v| * 10^6 to an integer and print it with a decimal point.
+    // fma gives the exact distance to the rounded value, if it is close to 0.5 the
+    // rounding of the product might differ from printf and snprintf decides.
+    scaled = a * 1e6;
+    if (isfinite(v) && scaled < 9007199254740992.0) {    // 2^53
+        r = nearbyint(scaled);
+        e = fma(a, 1e6, -r);
+        if (fabs(e) < 0.5 - 1e-9) {
+            u = (uint64_t) r;
+            if (signbit(v)) {
+                buf[len++] = '-';
+            }
+            len += format_uint(buf + len, u / 1000000, 1);
+            buf[len++] = '.';
+            len += format_uint(buf + len, u % 1000000, 6);
+            return len;
+        }
+    }
+
+    return (size_t) snprintf(buf, MATWRITE_MAX_DOUBLE, "%lf", v);
+}
+
+bool matwrite_all(int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Could not write output!");
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool matwrite_str(int fd, const char *str)
+{
+    return matwrite_all(fd, str, strlen(str));
+}
+
+typedef struct {
+    pthread_t thread_id;
+    const void *data;
+    bool is_double;
+    size_t cols;
+    size_t first, last;     // Rows formatted by this thread
+    char *buf;
+    size_t len, cap;
+} block_t;
+
+static void * format_block(void * arg)
+{
+    block_t *b = arg;
+    size_t i, j;
+    size_t max = b->is_double ? MATWRITE_MAX_DOUBLE : MATWRITE_MAX_INT;
+
+    b->len = 0;
+    for (i = b->first; i < b->last; ++i) {
+        for (j = 0; j < b->cols; ++j) {
+            if (b->cap - b->len < max + 3) {
+                b->cap = 2 * b->cap + max + 3;
+                b->buf = realloc(b->buf, b->cap);
+                if (b->buf == NULL) {
+                    perror("Could not allocate memory for output!");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if (b->is_double) {
+                b->len += matwrite_format_double(b->buf + b->len, ((const double *) b->data)[i * b->cols + j]);
+            } else {
+                b->len += matwrite_format_int(b->buf + b->len, ((const int64_t *) b->data)[i * b->cols + j]);
+            }
+            b->buf[b->len++] = '\t';
+            b->buf[b->len++] = ' ';
+        }
+        if (b->cap - b->len < 1) {
+            b->cap = 2 * b->cap + 1;
+            b->buf = realloc(b->buf, b->cap);
+            if (b->buf == NULL) {
+                perror("Could not allocate memory for output!");
+                exit(EXIT_FAILURE);
+            }
+        }
+        b->buf[b->len++] = '\n';
+    }
+    return NULL;
+}
+
+static bool write_text(int fd, const void *data, bool is_double, size_t rows, size_t cols, int nthreads)
+{
+    int t, used;
+    size_t row = 0, rows_per_block;
+    bool ok = true;
+
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+
+    // Roughly BLOCK_BYTES of text per block, assuming short numbers
+    rows_per_block = BLOCK_BYTES / ((cols + 1) * (is_double ? 12 : 4));
+    if (rows_per_block == 0) {
+        rows_per_block = 1;
+    }
+
+    block_t *blocks = calloc(nthreads, sizeof(block_t));
+    if (blocks == NULL) {
+        perror("Could not allocate memory for output!");
+        exit(EXIT_FAILURE);
+    }
+
+    // Every round formats up to nthreads blocks in parallel and writes them in order
+    while (ok && row < rows) {
+        for (used = 0; used < nthreads && row < rows; ++used) {
+            blocks[used].data = data;
+            blocks[used].is_double = is_double;
+            blocks[used].cols = cols;
+            blocks[used].first = row;
+            row = (rows - row > rows_per_block) ? row + rows_per_block : rows;
+            blocks[used].last = row;
+        }
+
+        for (t = 1; t < used; ++t) {
+            if (pthread_create(&blocks[t].thread_id, NULL, &format_block, &blocks[t]) != 0) {
+                perror("Couldnt create thread!");
+                exit(EXIT_FAILURE);
+            }
+        }
+        format_block(&blocks[0]);
+        for (t = 1; t < used; ++t) {
+            pthread_join(blocks[t].thread_id, NULL);
+        }
+
+        for (t = 0; t < used && ok; ++t) {
+            ok = matwrite_all(fd, blocks[t].buf, blocks[t].len);
+        }
+    }
+
+    for (t = 0; t < nthreads; ++t) {
+        free(blocks[t].buf);
+    }
+    free(blocks);
+    return ok;
+}
+
+bool matwrite_text_int64(int fd, const int64_t *data, size_t rows, size_t cols, int nthreads)
+{
+    return write_text(fd, data, false, rows, cols, nthreads);
+}
+
+bool matwrite_text_double(int fd, const double *data, size_t rows, size_t cols, int nthreads)
+{
+    return write_text(fd, data, true, rows, cols, nthreads);
+}
+
+bool matwrite_binary(int fd, uint32_t elem_type, const void *data, size_t rows, size_t cols)
+{
+    matfile_header hdr;
+    char pad[MATFILE_ALIGNMENT] = { 0 };
+
+    matfile_init_header(&hdr, elem_type, rows, cols, 0);
+    return matwrite_all(fd, (const char *) &hdr, sizeof(hdr))
+           && matwrite_all(fd, pad, hdr.data_offset - sizeof(hdr))
+           && matwrite_all(fd, data, rows * cols * matfile_elem_size(elem_type));
+}
+
+uint64_t matwrite_hash(const void *data, size_t count)
+{
+    return matwrite_hash_update(MATWRITE_HASH_INIT, data, count);
+}
+
+uint64_t matwrite_hash_update(uint64_t h, const void *data, size_t count)
+{
+    const uint64_t *w = data;
+    size_t i;
+
+    for (i = 0; i < count; ++i) {
+        h ^= w[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
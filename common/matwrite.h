@@ -0,0 +1,51 @@
+#ifndef MATWRITE_H
+#define MATWRITE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Fast output of result matrices.
+ *
+ * Text output produces exactly what printf("%lld\t ") / printf("%lf\t ")
+ * per element and "\n" per row would, but formats the numbers without
+ * stdio: blocks of rows are formatted in parallel into large buffers which
+ * are then written in order with write(2). */
+
+typedef enum {
+    MATWRITE_TEXT,      // Elements as text, followed by the sum
+    MATWRITE_BINARY,    // Binary matrix, see matfile.h
+    MATWRITE_SUM        // Only the sum and a hash of the elements
+} matwrite_mode;
+
+/* Parse "text", "binary" or "sum", returns false for anything else */
+bool matwrite_parse_mode(const char *name, matwrite_mode *mode);
+
+/* Format v into buf, which needs room for MATWRITE_MAX_INT (or
+ * MATWRITE_MAX_DOUBLE) characters. Returns the number of characters
+ * written, no terminating zero is added. */
+#define MATWRITE_MAX_INT 20
+#define MATWRITE_MAX_DOUBLE 330
+size_t matwrite_format_int(char *buf, int64_t v);
+size_t matwrite_format_double(char *buf, double v);     // Same as "%lf"
+
+/* Write rows x cols elements as text to fd, using nthreads threads */
+bool matwrite_text_int64(int fd, const int64_t *data, size_t rows, size_t cols, int nthreads);
+bool matwrite_text_double(int fd, const double *data, size_t rows, size_t cols, int nthreads);
+
+/* Write the matrix in the binary format (elem_type from matfile.h) to fd */
+bool matwrite_binary(int fd, uint32_t elem_type, const void *data, size_t rows, size_t cols);
+
+/* Write a string / all of buf to fd */
+bool matwrite_str(int fd, const char *str);
+bool matwrite_all(int fd, const char *buf, size_t len);
+
+/* 64 bit FNV-1a style hash that mixes in one 8 byte element per step */
+uint64_t matwrite_hash(const void *data, size_t count);
+
+/* The same hash over several pieces: h = MATWRITE_HASH_INIT for the first
+ * piece, then the value returned for the previous one */
+#define MATWRITE_HASH_INIT 0xcbf29ce484222325ULL
+uint64_t matwrite_hash_update(uint64_t h, const void *data, size_t count);
+
+#endif /* MATWRITE_H */
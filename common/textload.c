@@ -0,0 +1,226 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "textload.h"
+
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+
+typedef struct {
+    pthread_t thread_id;
+    const char *begin, *end;    // Chunk of the file
+    size_t count;               // Numbers in the chunk
+    size_t first;               // Index of the first number of the chunk
+    size_t total;               // rows * cols, numbers after that are ignored
+    int rows, cols;
+    bool transposed;
+    int64_t *data;
+} chunk_t;
+
+/* Parse the number starting at p, return the position after it */
+static const char *scan_int(const char *p, const char *end, int64_t *value)
+{
+    bool negative = false;
+    uint64_t v = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    while (p < end && (unsigned) (*p - '0') < 10) {
+        v = v * 10 + (uint64_t) (*p - '0');
+        ++p;
+    }
+
+    *value = negative ? (int64_t) -v : (int64_t) v;
+    return p;
+}
+
+static void * count_chunk(void * arg)
+{
+    chunk_t *c = arg;
+    const char *p = c->begin;
+    size_t count = 0;
+    bool in_number = false;
+
+    for (; p < c->end; ++p) {
+        if (IS_SPACE(*p)) {
+            in_number = false;
+        } else if (!in_number) {
+            in_number = true;
+            ++count;
+        }
+    }
+
+    c->count = count;
+    return NULL;
+}
+
+static void * parse_chunk(void * arg)
+{
+    chunk_t *c = arg;
+    const char *p = c->begin;
+    size_t idx = c->first, last = c->first + c->count;
+    size_t i, j;
+    int64_t value;
+
+    if (last > c->total) {
+        last = c->total;
+    }
+
+    // i, j follow idx without a division per element
+    i = (c->cols > 0) ? idx / c->cols : 0;
+    j = (c->cols > 0) ? idx % c->cols : 0;
+
+    while (idx < last) {
+        while (p < c->end && IS_SPACE(*p)) {
+            ++p;
+        }
+        p = scan_int(p, c->end, &value);
+
+        if (c->transposed) {
+            c->data[j * c->rows + i] = value;
+        } else {
+            c->data[idx] = value;
+        }
+
+        ++idx;
+        if (++j == (size_t) c->cols) {
+            j = 0;
+            ++i;
+        }
+
+        // Skip the rest of a malformed token
+        while (p < c->end && !IS_SPACE(*p)) {
+            ++p;
+        }
+    }
+
+    return NULL;
+}
+
+/* Run fn on all chunks, each in its own thread */
+static void run_chunks(chunk_t *chunks, int n, void * (*fn)(void *))
+{
+    int i;
+
+    for (i = 1; i < n; ++i) {
+        if (pthread_create(&chunks[i].thread_id, NULL, fn, &chunks[i]) != 0) {
+            perror("Couldnt create thread!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    fn(&chunks[0]);     // The calling thread parses the first chunk
+    for (i = 1; i < n; ++i) {
+        pthread_join(chunks[i].thread_id, NULL);
+    }
+}
+
+bool textload_matrix(const char *path, bool transposed, int nthreads,
+                     int *rows, int *cols, int64_t **data)
+{
+    int fd, i;
+    struct stat st;
+    const char *map, *p, *end, *body;
+    int64_t dim[2];
+    size_t total, len, first;
+    bool ok = true;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        perror("Can't open file!");
+        return false;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: empty matrix file\n", path);
+        close(fd);
+        return false;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Can't map file!");
+        return false;
+    }
+    end = map + st.st_size;
+
+    // Dimensions
+    p = map;
+    for (i = 0; i < 2; ++i) {
+        while (p < end && IS_SPACE(*p)) {
+            ++p;
+        }
+        p = scan_int(p, end, &dim[i]);
+    }
+    if (dim[0] < 0 || dim[1] < 0) {
+        fprintf(stderr, "%s: invalid matrix dimensions\n", path);
+        munmap((void *) map, st.st_size);
+        return false;
+    }
+    *rows = (int) dim[0];
+    *cols = (int) dim[1];
+    total = (size_t) dim[0] * (size_t) dim[1];
+    body = p;
+
+    *data = malloc(total * sizeof(int64_t));
+    if (*data == NULL) {
+        munmap((void *) map, st.st_size);
+        return false;
+    }
+
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    chunk_t *chunks = calloc(nthreads, sizeof(chunk_t));
+    if (chunks == NULL) {
+        perror("Could not allocate memory for chunks!");
+        exit(EXIT_FAILURE);
+    }
+
+    // Split the body into chunks that end after a newline
+    len = end - body;
+    p = body;
+    for (i = 0; i < nthreads; ++i) {
+        const char *split = body + len * (i + 1) / nthreads;
+        if (i == nthreads - 1 || split < p) {
+            split = (i == nthreads - 1) ? end : p;
+        } else {
+            const char *nl = memchr(split, '\n', end - split);
+            split = (nl == NULL) ? end : nl + 1;
+        }
+
+        chunks[i].begin = p;
+        chunks[i].end = split;
+        chunks[i].rows = *rows;
+        chunks[i].cols = *cols;
+        chunks[i].total = total;
+        chunks[i].transposed = transposed;
+        chunks[i].data = *data;
+        p = split;
+    }
+
+    run_chunks(chunks, nthreads, &count_chunk);
+
+    first = 0;
+    for (i = 0; i < nthreads; ++i) {
+        chunks[i].first = first;
+        first += chunks[i].count;
+    }
+
+    if (first < total) {
+        fprintf(stderr, "%s: matrix is truncated (%zu of %zu elements)\n", path, first, total);
+        free(*data);
+        *data = NULL;
+        ok = false;
+    } else {
+        run_chunks(chunks, nthreads, &parse_chunk);
+    }
+
+    free(chunks);
+    munmap((void *) map, st.st_size);
+    return ok;
+}
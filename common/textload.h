@@ -0,0 +1,24 @@
+#ifndef TEXTLOAD_H
+#define TEXTLOAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Parallel loader for the text matrix format (see pthreads/matrix.txt):
+ * the number of rows and columns followed by the whitespace separated
+ * elements, row by row.
+ *
+ * The file is mapped and the part after the dimensions is split at line
+ * boundaries into one chunk per thread. In a first pass every thread counts
+ * the numbers in its chunk, which gives the index of the first element of
+ * each chunk. In the second pass the threads parse their chunk and write
+ * the elements directly to their final place. */
+
+/* Load the matrix at path into a newly allocated (malloc) array of
+ * rows * cols elements, row major or transposed (column by column).
+ * Returns false and prints a message if the file can't be read or holds
+ * fewer elements than its dimensions say. */
+bool textload_matrix(const char *path, bool transposed, int nthreads,
+                     int *rows, int *cols, int64_t **data);
+
+#endif /* TEXTLOAD_H */
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include "gemm.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+bool gemm_packed_b_alloc(gemm_packed_b *pb, int k, int n)
+{
+    pb->k = k;
+    pb->n = n;
+    pb->n_pad = ((n + GEMM_NR - 1) / GEMM_NR) * GEMM_NR;
+    pb->data = malloc((size_t) k * pb->n_pad * sizeof(gemm_elem_t));
+    return pb->data != NULL;
+}
+
+void gemm_packed_b_free(gemm_packed_b *pb)
+{
+    free(pb->data);
+    pb->data = NULL;
+}
+
+int gemm_panels(const gemm_packed_b *pb)
+{
+    return pb->n_pad / GEMM_NR;
+}
+
+size_t gemm_pack_a_size(void)
+{
+    return (size_t) ((GEMM_MC + GEMM_MR - 1) / GEMM_MR) * GEMM_MR * GEMM_KC;
+}
+
+void gemm_pack_b(gemm_packed_b *pb, const gemm_elem_t *b, size_t rs, size_t cs, int p0, int p1)
+{
+    int pc, kc, p, x, jj, j;
+
+    for (pc = 0; pc < pb->k; pc += GEMM_KC) {
+        kc = MIN(GEMM_KC, pb->k - pc);
+        for (p = p0; p < p1; ++p) {
+            gemm_elem_t *dst = pb->data + (size_t) pc * pb->n_pad + (size_t) p * GEMM_NR * kc;
+            for (x = 0; x < kc; ++x) {
+                for (jj = 0; jj < GEMM_NR; ++jj) {
+                    j = p * GEMM_NR + jj;
+                    dst[x * GEMM_NR + jj] = (j < pb->n) ? b[(size_t) (pc + x) * rs + (size_t) j * cs] : 0;
+                }
+            }
+        }
+    }
+}
+
+/* Pack the rows [ic, ic + mc) and columns [pc, pc + kc) of A into MR high
+ * panels, each of them k-major. Missing rows of the last panel are zero. */
+static void pack_a(const gemm_elem_t *a, size_t lda, int ic, int mc, int pc, int kc, gemm_elem_t *dst)
+{
+    int ir, ii, x;
+
+    for (ir = 0; ir < mc; ir += GEMM_MR) {
+        for (ii = 0; ii < GEMM_MR; ++ii) {
+            if (ir + ii < mc) {
+                const gemm_elem_t *src = a + (size_t) (ic + ir + ii) * lda + pc;
+                for (x = 0; x < kc; ++x) {
+                    dst[x * GEMM_MR + ii] = src[x];
+                }
+            } else {
+                for (x = 0; x < kc; ++x) {
+                    dst[x * GEMM_MR + ii] = 0;
+                }
+            }
+        }
+        dst += (size_t) GEMM_MR * kc;
+    }
+}
+
+/* C[0..mr) x [0..nr) (+)= one MR panel of A times one NR panel of B.
+ * The full MR x NR block is always computed in registers, only the valid
+ * part is written back. */
+static void micro_kernel(int kc, const gemm_elem_t *restrict ap, const gemm_elem_t *restrict bp,
+                         gemm_elem_t *restrict c, size_t ldc, int mr, int nr, bool accumulate)
+{
+    gemm_elem_t ab[GEMM_MR][GEMM_NR] = {{0}};
+    int x, i, j;
+
+    for (x = 0; x < kc; ++x) {
+        for (i = 0; i < GEMM_MR; ++i) {
+            for (j = 0; j < GEMM_NR; ++j) {
+                ab[i][j] += ap[i] * bp[j];
+            }
+        }
+        ap += GEMM_MR;
+        bp += GEMM_NR;
+    }
+
+    for (i = 0; i < mr; ++i) {
+        for (j = 0; j < nr; ++j) {
+            if (accumulate) {
+                c[i * ldc + j] += ab[i][j];
+            } else {
+                c[i * ldc + j] = ab[i][j];
+            }
+        }
+    }
+}
+
+void gemm_tile(const gemm_elem_t *a, size_t lda, const gemm_packed_b *pb,
+               gemm_elem_t *c, size_t ldc, int i0, int i1, int j0, int j1,
+               gemm_elem_t *a_buf)
+{
+    int jc, nc, pc, kc, ic, mc, jr, ir;
+
+    for (jc = j0; jc < j1; jc += GEMM_NC) {
+        nc = MIN(GEMM_NC, j1 - jc);
+        for (pc = 0; pc < pb->k; pc += GEMM_KC) {
+            kc = MIN(GEMM_KC, pb->k - pc);
+            for (ic = i0; ic < i1; ic += GEMM_MC) {
+                mc = MIN(GEMM_MC, i1 - ic);
+                pack_a(a, lda, ic, mc, pc, kc, a_buf);
+
+                for (jr = jc; jr < jc + nc; jr += GEMM_NR) {
+                    const gemm_elem_t *bp = pb->data + (size_t) pc * pb->n_pad + (size_t) (jr / GEMM_NR) * GEMM_NR * kc;
+                    for (ir = 0; ir < mc; ir += GEMM_MR) {
+                        micro_kernel(kc, a_buf + (size_t) ir * kc, bp,
+                                     c + (size_t) (ic + ir) * ldc + jr, ldc,
+                                     MIN(GEMM_MR, mc - ir), MIN(GEMM_NR, jc + nc - jr), pc != 0);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int64_t gemm_elem_t;
+
+/* Register block of the micro-kernel: GEMM_MR rows of A times GEMM_NR
+ * columns of B are accumulated in registers (vectorized with -O3). */
+#define GEMM_MR 4
+#define GEMM_NR 4
+
+/* Cache blocking:
+ *  - a KC x NR sliver of packed B stays in L1,
+ *  - an MC x KC block of packed A stays in L2,
+ *  - a KC x NC block of packed B stays in L3. */
+#define GEMM_KC 256
+#define GEMM_MC 128
+#define GEMM_NC 2048
+
+/* Packed copy of the k x n matrix B.
+ * For every block of GEMM_KC rows the columns are stored in GEMM_NR wide
+ * panels, each panel k-major (the NR elements of one row of the panel are
+ * contiguous). The last panel is zero padded, so n_pad is n rounded up to a
+ * multiple of GEMM_NR. */
+typedef struct {
+    int k, n, n_pad;
+    gemm_elem_t *data;
+} gemm_packed_b;
+
+bool gemm_packed_b_alloc(gemm_packed_b *pb, int k, int n);
+void gemm_packed_b_free(gemm_packed_b *pb);
+
+/* Number of GEMM_NR wide panels of a packed B */
+int gemm_panels(const gemm_packed_b *pb);
+
+/* Pack the panels [p0, p1) of B into pb.
+ * Element (x, j) of B is read from b[x * rs + j * cs], so a row major B is
+ * packed with (rs, cs) = (n, 1) and a transposed one with (1, k). */
+void gemm_pack_b(gemm_packed_b *pb, const gemm_elem_t *b, size_t rs, size_t cs, int p0, int p1);
+
+/* Number of elements of the scratch buffer gemm_tile needs to pack A */
+size_t gemm_pack_a_size(void);
+
+/* Calculate the tile C[i0..i1) x [j0..j1) = A[i0..i1) x B[.., j0..j1).
+ * A is row major with leading dimension lda, C with ldc. j0 has to be a
+ * multiple of GEMM_NR. a_buf must hold gemm_pack_a_size() elements and
+ * must not be shared between threads. */
+void gemm_tile(const gemm_elem_t *a, size_t lda, const gemm_packed_b *pb,
+               gemm_elem_t *c, size_t ldc, int i0, int i1, int j0, int j1,
+               gemm_elem_t *a_buf);
+
+#endif /* GEMM_H */
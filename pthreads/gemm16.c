@@ -0,0 +1,242 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gemm16.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEMM16_X86
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+typedef void (*micro_kernel_fn)(int pairs, const int16_t *ap, const int16_t *bp, int32_t *ab);
+
+static inline int16_t load(const void *p, size_t i, int width)
+{
+    return (width == 1) ? ((const int8_t *) p)[i] : ((const int16_t *) p)[i];
+}
+
+/* The pair of elements of one row of packed A as int32 */
+static inline int32_t load_pair(const int16_t *p)
+{
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+bool gemm16_fits(int64_t max_a, int64_t max_b)
+{
+    // A pair of products has to fit into int32
+    return max_a <= INT16_MAX && max_b <= INT16_MAX && 2 * max_a * max_b <= INT32_MAX;
+}
+
+bool gemm16_packed_b_alloc(gemm16_packed_b *pb, int k, int n, int64_t max_a, int64_t max_b)
+{
+    // Every accumulator sums kc products of at most max_a * max_b
+    int64_t bound = max_a * max_b;
+    int64_t kc = (bound > 0) ? INT32_MAX / bound : GEMM16_KC;
+
+    pb->kc = (int) MIN(kc, GEMM16_KC) & ~1;
+    pb->k = k;
+    pb->n = n;
+    pb->n_pad = ((n + GEMM16_NR - 1) / GEMM16_NR) * GEMM16_NR;
+    // kc is even, only the last block may need a row of padding
+    pb->data = malloc((size_t) ((k + 1) & ~1) * pb->n_pad * sizeof(int16_t));
+    return pb->data != NULL;
+}
+
+void gemm16_packed_b_free(gemm16_packed_b *pb)
+{
+    free(pb->data);
+    pb->data = NULL;
+}
+
+int gemm16_panels(const gemm16_packed_b *pb)
+{
+    return pb->n_pad / GEMM16_NR;
+}
+
+size_t gemm16_pack_a_size(void)
+{
+    return (size_t) ((GEMM16_MC + GEMM16_MR - 1) / GEMM16_MR) * GEMM16_MR * GEMM16_KC;
+}
+
+void gemm16_pack_b(gemm16_packed_b *pb, const void *b, int width, size_t rs, size_t cs, int p0, int p1)
+{
+    int pc, kc, p, x, jj, j;
+
+    for (pc = 0; pc < pb->k; pc += pb->kc) {
+        kc = MIN(pb->kc, pb->k - pc);
+        for (p = p0; p < p1; ++p) {
+            int16_t *dst = pb->data + (size_t) pc * pb->n_pad + (size_t) p * GEMM16_NR * ((kc + 1) & ~1);
+            for (x = 0; x < ((kc + 1) & ~1); ++x) {
+                for (jj = 0; jj < GEMM16_NR; ++jj) {
+                    j = p * GEMM16_NR + jj;
+                    // Rows x and x + 1 of a column are next to each other
+                    dst[(x / 2) * 2 * GEMM16_NR + 2 * jj + x % 2] =
+                        (j < pb->n && x < kc) ? load(b, (size_t) (pc + x) * rs + (size_t) j * cs, width) : 0;
+                }
+            }
+        }
+    }
+}
+
+/* Pack the rows [ic, ic + mc) and columns [pc, pc + kc) of A into MR high
+ * panels. Each pair of columns is stored row by row, so the two elements
+ * of a row are one int32. Missing rows and the odd column are zero. */
+static void pack_a(const void *a, int width, size_t lda, int ic, int mc, int pc, int kc, int16_t *dst)
+{
+    int ir, ii, x, kp = (kc + 1) & ~1;
+
+    for (ir = 0; ir < mc; ir += GEMM16_MR) {
+        for (ii = 0; ii < GEMM16_MR; ++ii) {
+            size_t row = (size_t) (ic + ir + ii) * lda + pc;
+            for (x = 0; x < kp; ++x) {
+                dst[(x / 2) * 2 * GEMM16_MR + 2 * ii + x % 2] =
+                    (ir + ii < mc && x < kc) ? load(a, row + x, width) : 0;
+            }
+        }
+        dst += (size_t) GEMM16_MR * kp;
+    }
+}
+
+static void micro_kernel_c(int pairs, const int16_t *ap, const int16_t *bp, int32_t *ab)
+{
+    int x, i, j;
+
+    for (i = 0; i < GEMM16_MR * GEMM16_NR; ++i) {
+        ab[i] = 0;
+    }
+    for (x = 0; x < pairs; ++x) {
+        for (i = 0; i < GEMM16_MR; ++i) {
+            for (j = 0; j < GEMM16_NR; ++j) {
+                ab[i * GEMM16_NR + j] += ap[2 * i] * bp[2 * j] + ap[2 * i + 1] * bp[2 * j + 1];
+            }
+        }
+        ap += 2 * GEMM16_MR;
+        bp += 2 * GEMM16_NR;
+    }
+}
+
+#ifdef GEMM16_X86
+
+/* The pair of elements of row i of A is broadcast and multiplied with the
+ * pairs of 16 columns of B (two vectors), giving 16 int32 sums per row */
+__attribute__((target("avx2")))
+static void micro_kernel_avx2(int pairs, const int16_t *ap, const int16_t *bp, int32_t *ab)
+{
+    __m256i c[GEMM16_MR][2];
+    int x, i;
+
+    for (i = 0; i < GEMM16_MR; ++i) {
+        c[i][0] = _mm256_setzero_si256();
+        c[i][1] = _mm256_setzero_si256();
+    }
+    for (x = 0; x < pairs; ++x) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i *) bp);
+        __m256i b1 = _mm256_loadu_si256((const __m256i *) (bp + 16));
+        for (i = 0; i < GEMM16_MR; ++i) {
+            __m256i a = _mm256_set1_epi32(load_pair(ap + 2 * i));
+            c[i][0] = _mm256_add_epi32(c[i][0], _mm256_madd_epi16(a, b0));
+            c[i][1] = _mm256_add_epi32(c[i][1], _mm256_madd_epi16(a, b1));
+        }
+        ap += 2 * GEMM16_MR;
+        bp += 2 * GEMM16_NR;
+    }
+
+    // Lane j of c[i][0] is column j, of c[i][1] column 8 + j
+    for (i = 0; i < GEMM16_MR; ++i) {
+        _mm256_storeu_si256((__m256i *) (ab + i * GEMM16_NR), c[i][0]);
+        _mm256_storeu_si256((__m256i *) (ab + i * GEMM16_NR + 8), c[i][1]);
+    }
+}
+
+__attribute__((target("avx512vnni,avx512vl")))
+static void micro_kernel_vnni(int pairs, const int16_t *ap, const int16_t *bp, int32_t *ab)
+{
+    __m256i c[GEMM16_MR][2];
+    int x, i;
+
+    for (i = 0; i < GEMM16_MR; ++i) {
+        c[i][0] = _mm256_setzero_si256();
+        c[i][1] = _mm256_setzero_si256();
+    }
+    for (x = 0; x < pairs; ++x) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i *) bp);
+        __m256i b1 = _mm256_loadu_si256((const __m256i *) (bp + 16));
+        for (i = 0; i < GEMM16_MR; ++i) {
+            __m256i a = _mm256_set1_epi32(load_pair(ap + 2 * i));
+            c[i][0] = _mm256_dpwssd_epi32(c[i][0], a, b0);
+            c[i][1] = _mm256_dpwssd_epi32(c[i][1], a, b1);
+        }
+        ap += 2 * GEMM16_MR;
+        bp += 2 * GEMM16_NR;
+    }
+
+    for (i = 0; i < GEMM16_MR; ++i) {
+        _mm256_storeu_si256((__m256i *) (ab + i * GEMM16_NR), c[i][0]);
+        _mm256_storeu_si256((__m256i *) (ab + i * GEMM16_NR + 8), c[i][1]);
+    }
+}
+
+#endif
+
+static micro_kernel_fn micro_kernel = micro_kernel_c;
+static pthread_once_t micro_kernel_once = PTHREAD_ONCE_INIT;
+
+// Pick the micro-kernel for this CPU, run once by the first tile
+static void select_kernel(void)
+{
+#ifdef GEMM16_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512vl")) {
+        micro_kernel = micro_kernel_vnni;
+    } else if (__builtin_cpu_supports("avx2")) {
+        micro_kernel = micro_kernel_avx2;
+    }
+#endif
+}
+
+void gemm16_tile(const void *a, int width, size_t lda, const gemm16_packed_b *pb,
+                 gemm_elem_t *c, size_t ldc, int i0, int i1, int j0, int j1,
+                 int16_t *a_buf)
+{
+    int32_t ab[GEMM16_MR * GEMM16_NR];
+    int jc, nc, pc, kc, kp, ic, mc, jr, ir, i, j, mr, nr;
+
+    pthread_once(&micro_kernel_once, select_kernel);
+
+    for (jc = j0; jc < j1; jc += GEMM16_NC) {
+        nc = MIN(GEMM16_NC, j1 - jc);
+        for (pc = 0; pc < pb->k; pc += pb->kc) {
+            kc = MIN(pb->kc, pb->k - pc);
+            kp = (kc + 1) & ~1;
+            for (ic = i0; ic < i1; ic += GEMM16_MC) {
+                mc = MIN(GEMM16_MC, i1 - ic);
+                pack_a(a, width, lda, ic, mc, pc, kc, a_buf);
+
+                for (jr = jc; jr < jc + nc; jr += GEMM16_NR) {
+                    const int16_t *bp = pb->data + (size_t) pc * pb->n_pad + (size_t) (jr / GEMM16_NR) * GEMM16_NR * kp;
+                    nr = MIN(GEMM16_NR, jc + nc - jr);
+                    for (ir = 0; ir < mc; ir += GEMM16_MR) {
+                        micro_kernel(kp / 2, a_buf + (size_t) ir * kp, bp, ab);
+
+                        // Widen the block sums into the int64 result
+                        mr = MIN(GEMM16_MR, mc - ir);
+                        gemm_elem_t *cb = c + (size_t) (ic + ir) * ldc + jr;
+                        for (i = 0; i < mr; ++i) {
+                            for (j = 0; j < nr; ++j) {
+                                if (pc != 0) {
+                                    cb[i * ldc + j] += ab[i * GEMM16_NR + j];
+                                } else {
+                                    cb[i * ldc + j] = ab[i * GEMM16_NR + j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef GEMM16_H
+#define GEMM16_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "gemm.h"
+
+/* Blocked multiplication of small integer matrices.
+ *
+ * Same structure as gemm.h, but A and B hold int8_t or int16_t elements
+ * (width 1 or 2 bytes) and are packed as int16_t, two consecutive k
+ * interleaved. The micro-kernel multiplies pairs and adds them into int32
+ * accumulators (pmaddwd, vpdpwssd with VNNI), which are added to the int64
+ * result after every block of k. The block depth is chosen so the int32
+ * accumulators can't overflow for the given bounds of the elements.
+ *
+ * The kernel is selected at runtime: AVX-512 VNNI, AVX2 or portable C. */
+
+#define GEMM16_MR 4
+#define GEMM16_NR 16
+
+#define GEMM16_KC 512
+#define GEMM16_MC 128
+#define GEMM16_NC 2048
+
+/* True if the product of matrices with elements of at most max_a and max_b
+ * (absolute values) can be calculated with this kernel */
+bool gemm16_fits(int64_t max_a, int64_t max_b);
+
+/* Packed copy of the k x n matrix B, layout as gemm_packed_b but with
+ * panels of GEMM16_NR columns and blocks of kc rows (even, zero padded). */
+typedef struct {
+    int k, n, n_pad, kc;
+    int16_t *data;
+} gemm16_packed_b;
+
+/* kc is derived from the bounds of the elements, see gemm16_fits */
+bool gemm16_packed_b_alloc(gemm16_packed_b *pb, int k, int n, int64_t max_a, int64_t max_b);
+void gemm16_packed_b_free(gemm16_packed_b *pb);
+
+int gemm16_panels(const gemm16_packed_b *pb);
+
+/* Pack the panels [p0, p1) of B, element (x, j) is read from b[x * rs + j * cs] */
+void gemm16_pack_b(gemm16_packed_b *pb, const void *b, int width, size_t rs, size_t cs, int p0, int p1);
+
+/* Number of elements of the scratch buffer gemm16_tile needs to pack A */
+size_t gemm16_pack_a_size(void);
+
+/* C[i0..i1) x [j0..j1) = A[i0..i1) x B[.., j0..j1), as gemm_tile.
+ * A is row major with leading dimension lda and elements of width bytes,
+ * j0 has to be a multiple of GEMM16_NR. */
+void gemm16_tile(const void *a, int width, size_t lda, const gemm16_packed_b *pb,
+                 gemm_elem_t *c, size_t ldc, int i0, int i1, int j0, int j1,
+                 int16_t *a_buf);
+
+#endif /* GEMM16_H */
@@ -1,10 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <stdint.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <getopt.h>
 #include <time.h>
+#include "affinity.h"
+#include "bench.h"
+#include "csr.h"
+#include "freivalds.h"
+#include "gemm.h"
+#include "gemm16.h"
+#include "matfile.h"
+#include "matwrite.h"
+#include "textload.h"
+#include "tpool.h"
 
 #define TIME_GET(timer) struct timespec timer; clock_gettime(CLOCK_MONOTONIC , &timer)
 #define TIME_DIFF(timer1 , timer2) ((timer2.tv_sec * 1.0E+9 + timer2.tv_nsec) - (timer1.tv_sec * 1.0E+9 + timer1.tv_nsec)) / 1.0E+9
@@ -14,104 +29,452 @@ typedef int64_t matrix_elem_t;
 typedef struct {
     int rows, cols;
     matrix_elem_t * data;
+    matfile_t file;     // Mapped binary file if data points into it
+    void * small;       // The elements as int8_t or int16_t instead of data, see narrow_matrix
+    int width;          // Size of the elements of small, 0 if data is used
+    int64_t max_abs;    // Largest absolute value of the elements of small
+    csr_matrix * sparse;    // The elements in CSR form instead of data, see sparsify_matrix
 } matrix_t;
 
+/* Size of the tiles of R the work is split into. TILE_ROWS is a multiple of
+ * GEMM_MR and TILE_COLS of GEMM_NR and GEMM16_NR. */
+#define TILE_ROWS GEMM_MC
+#define TILE_COLS 256
+
+// Panels of B packed by one task
+#define PACK_PANELS 64
+
 typedef struct {
-    pthread_t thread_id;
-    matrix_t * a, * b, *r;
-    int i, j;
-} thread_info;
+    matrix_t * a, * b, * r;
+    void * a_data;              // A, or in NUMA mode a copy placed by the workers
+    bool small;                 // A and B are narrowed and multiplied with gemm16.h
+    gemm_packed_b * pb;         // Packed B, one copy per NUMA node if replicated
+    gemm16_packed_b * pb16;     // Same for small elements
+    int copies;                 // Number of packed copies of B
+    int * copy;                 // Copy of B used by every worker
+    int * rank, * size;         // Index of a worker among those using its copy / number of them
+    void ** a_buf;              // Packing buffer for A of every worker
+    int tile_rows, tile_cols;   // Number of tiles in each dimension
+} mult_job;
+
+/* NUMA mode, see matrix_mult_numa */
+typedef struct {
+    bool enabled;       // Place A, R and packed B by first touch of their users
+    int * cpus;         // Affinity map, NULL if threads are not pinned
+    int ncpus;
+    bool replicate;     // One packed copy of B per NUMA node
+} numa_options;
 
-void print_matrix(matrix_t m){
-    int i, j;
+static numa_options numa = { false, NULL, 0, false };
+
+// Created by the first multiplication and reused by all following ones
+static tpool_t * pool = NULL;
+
+/**
+* Write the result to fd: all elements followed by their sum (MATWRITE_TEXT),
+* a binary matrix (MATWRITE_BINARY) or only the sum and a hash (MATWRITE_SUM).
+* Text is formatted by t threads.
+*/
+bool print_matrix(matrix_t m, matwrite_mode mode, int fd, int t){
+    size_t i;
     matrix_elem_t sum;
+    char line[64];
+
+    if (mode == MATWRITE_BINARY) {
+        return matwrite_binary(fd, MATFILE_INT64, m.data, m.rows, m.cols);
+    }
 
     sum = 0;
-    for (i = 0; i < m.rows; ++i) {
-        for (j = 0; j < m.cols; ++j) {
-            sum += m.data[(i * m.cols) + j];
-            printf("%lld\t ", m.data[(i * m.cols) + j]);
-        }
-        printf("\n");
+    for (i = 0; i < (size_t) m.rows * m.cols; ++i) {
+        sum += m.data[i];
+    }
+
+    if (mode == MATWRITE_TEXT && !matwrite_text_int64(fd, m.data, m.rows, m.cols, t)) {
+        return false;
+    }
+
+    snprintf(line, sizeof(line), "sum: %lld\n", (long long) sum);
+    if (mode == MATWRITE_SUM) {
+        snprintf(line + strlen(line), sizeof(line) - strlen(line), "hash: %016llx\n",
+                 (unsigned long long) matwrite_hash(m.data, (size_t) m.rows * m.cols));
     }
-    printf("sum: %lld\n", sum);
+    return matwrite_str(fd, line);
 }
 
-bool read_matrix(char *filepath, matrix_t* matrix, bool read_transposed)
+void free_matrix(matrix_t * matrix)
 {
-    int i, j, x;
-    FILE *fp;
+    if (matrix->file.map != NULL) {
+        matfile_close(&matrix->file);
+    } else {
+        free(matrix->data);
+    }
+    matrix->data = NULL;
+    free(matrix->small);
+    matrix->small = NULL;
+    matrix->width = 0;
+    if (matrix->sparse != NULL) {
+        csr_free(matrix->sparse);
+        free(matrix->sparse);
+        matrix->sparse = NULL;
+    }
+}
 
-    // Try to open the file with read permissions
-    if ((fp = fopen(filepath, "r")) == NULL) {
-        perror("Can't open file!");
-        exit(EXIT_SUCCESS);
+/**
+* Store the elements in CSR form if fewer than CSR_DENSITY of them are nonzero
+* (see csr.h). The dense elements are freed, but only after both forms were held.
+*/
+void sparsify_matrix(matrix_t * matrix, bool transposed)
+{
+    size_t nnz = csr_count(matrix->data, (size_t) matrix->rows * matrix->cols);
+    if (!csr_is_sparse(nnz, matrix->rows, matrix->cols)) {
+        return;
     }
 
-    // Read the matrix dimenstions
-    fscanf(fp, "%d", &matrix->rows);
-    fscanf(fp, "%d", &matrix->cols);    
+    csr_matrix * sparse = malloc(sizeof(csr_matrix));
+    if (sparse == NULL || !csr_from_dense(sparse, matrix->data, matrix->rows, matrix->cols, transposed, nnz)) {
+        perror("Could not allocate memory for matrix!");
+        exit(EXIT_FAILURE);
+    }
+    free_matrix(matrix);
+    matrix->sparse = sparse;
+}
 
-    // Allocate space for matrix
-    matrix->data = calloc(matrix->rows * matrix->cols, sizeof(matrix_elem_t));
+/**
+* Convert a sparse matrix back to dense int64 elements, stored transposed if requested
+*/
+void densify_matrix(matrix_t * matrix, bool transposed)
+{
+    matrix->data = malloc((size_t) matrix->rows * matrix->cols * sizeof(matrix_elem_t));
     if (matrix->data == NULL) {
-        return false;
+        perror("Could not allocate memory for matrix!");
+        exit(EXIT_FAILURE);
     }
+    csr_to_dense(matrix->sparse, matrix->data, transposed);
+    csr_free(matrix->sparse);
+    free(matrix->sparse);
+    matrix->sparse = NULL;
+}
 
-    // Read the matrix or read and transpose the matrix.
-    if (read_transposed) {
-        for (i = 0; i < matrix->rows; ++i) {
-            for (j = 0; j < matrix->cols; ++j) {
-                fscanf(fp, "%d\t", &x);
-                matrix->data[(matrix->cols * j) + i] = x;
-            }
-            fscanf(fp, "\n");   // Newline at the end of each row
+/**
+* Store the elements as int8_t or int16_t if all of them fit, so the multiplication
+* reads a quarter or an eighth of the memory (see gemm16.h). The int64 elements are freed.
+*/
+void narrow_matrix(matrix_t * matrix)
+{
+    size_t i, count = (size_t) matrix->rows * matrix->cols;
+    matrix_elem_t min = 0, max = 0;
+
+    for (i = 0; i < count; ++i) {
+        if (matrix->data[i] < min) {
+            min = matrix->data[i];
+        } else if (matrix->data[i] > max) {
+            max = matrix->data[i];
         }
-    } else {
-        for (i = 0; i < matrix->rows; ++i) {
-            for (j = 0; j < matrix->cols; ++j) {
-                fscanf(fp, "%d\t", &x);
-                matrix->data[(matrix->cols * i) + j] = x;
-            }
-            fscanf(fp, "\n");
+    }
+    if (min < INT16_MIN || max > INT16_MAX) {
+        return;
+    }
+
+    int width = (min >= INT8_MIN && max <= INT8_MAX) ? 1 : 2;
+    void * small = malloc(count * width);
+    if (small == NULL) {
+        perror("Could not allocate memory for matrix!");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < count; ++i) {
+        if (width == 1) {
+            ((int8_t *) small)[i] = (int8_t) matrix->data[i];
+        } else {
+            ((int16_t *) small)[i] = (int16_t) matrix->data[i];
         }
     }
 
-    fclose(fp); // Close the file
-    return true;
+    free_matrix(matrix);
+    matrix->small = small;
+    matrix->width = width;
+    matrix->max_abs = (max > -min) ? max : -min;
+}
+
+/**
+* Convert a narrowed matrix back to int64 elements
+*/
+void widen_matrix(matrix_t * matrix)
+{
+    size_t i, count = (size_t) matrix->rows * matrix->cols;
+
+    matrix->data = malloc(count * sizeof(matrix_elem_t));
+    if (matrix->data == NULL) {
+        perror("Could not allocate memory for matrix!");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < count; ++i) {
+        matrix->data[i] = (matrix->width == 1) ? ((int8_t *) matrix->small)[i] : ((int16_t *) matrix->small)[i];
+    }
+    free(matrix->small);
+    matrix->small = NULL;
+    matrix->width = 0;
+}
+
+/**
+* Element i of the int64 or narrowed elements of a matrix
+*/
+static inline uint64_t element(const matrix_t * m, size_t i)
+{
+    switch (m->width) {
+    case 1:
+        return (uint64_t) ((int8_t *) m->small)[i];
+    case 2:
+        return (uint64_t) ((int16_t *) m->small)[i];
+    default:
+        return (uint64_t) m->data[i];
+    }
+}
+
+/**
+* Map a binary matrix (see matfile.h). If the file already holds int64 elements in
+* the requested layout they are used in place, otherwise they are converted into
+* a newly allocated matrix.
+*/
+bool read_binary_matrix(char *filepath, matrix_t* matrix, bool read_transposed)
+{
+    if (!matfile_open(filepath, &matrix->file)) {
+        return false;
+    }
+
+    matrix->rows = (int) matrix->file.hdr.rows;
+    matrix->cols = (int) matrix->file.hdr.cols;
+
+    if (matfile_matches(&matrix->file, MATFILE_INT64, read_transposed)) {
+        matrix->data = matrix->file.data;
+        return true;
+    }
+
+    matrix->data = malloc((size_t) matrix->rows * matrix->cols * sizeof(matrix_elem_t));
+    if (matrix->data != NULL) {
+        matfile_load_block(&matrix->file, MATFILE_INT64, read_transposed, 0, matrix->rows, 0, matrix->cols,
+                           matrix->data, read_transposed ? matrix->rows : matrix->cols);
+    }
+    matfile_close(&matrix->file);
+    return matrix->data != NULL;
+}
+
+/**
+* Read a binary or text matrix. Text files are parsed by t threads (see textload.h),
+* which write the elements (transposed if requested) directly to their place.
+*/
+bool read_matrix(char *filepath, matrix_t* matrix, bool read_transposed, int t)
+{
+    bool ok;
+
+    if (matfile_is_binary(filepath)) {
+        ok = read_binary_matrix(filepath, matrix, read_transposed);
+    } else {
+        ok = textload_matrix(filepath, read_transposed, t, &matrix->rows, &matrix->cols, &matrix->data);
+    }
+
+    if (ok) {
+        sparsify_matrix(matrix, read_transposed);
+    }
+    if (ok && matrix->sparse == NULL) {
+        narrow_matrix(matrix);
+    }
+    return ok;
+}
+
+typedef struct {
+    pthread_t thread_id;
+    char * filepath;
+    matrix_t * matrix;
+    bool read_transposed;
+    int t;
+    bool ok;
+} read_info;
+
+void * read_matrix_thread(void * arg) {
+    read_info * info = arg;
+    info->ok = read_matrix(info->filepath, info->matrix, info->read_transposed, info->t);
+    return NULL;
+}
+
+/**
+* Number of panels of the packed B
+*/
+int packed_panels(mult_job * job) {
+    return job->small ? gemm16_panels(&job->pb16[0]) : gemm_panels(&job->pb[0]);
 }
 
 /**
-* Calculate a given part of the matrix.
+* Pack the panels [p0, p1) of the given copy of B.
+* B is stored transposed: element (x, j) is at b[j * n + x]
+*/
+void pack_panels(mult_job * job, int copy, int p0, int p1) {
+    if (job->small) {
+        gemm16_pack_b(&job->pb16[copy], job->b->small, job->b->width, 1, job->b->rows, p0, p1);
+    } else {
+        gemm_pack_b(&job->pb[copy], job->b->data, 1, job->b->rows, p0, p1);
+    }
+}
+
+/**
+* Pack the panels [task * PACK_PANELS, (task + 1) * PACK_PANELS) of B.
+*/
+void pack_task(void * arg, int task, int worker) {
+    (void) worker;
+    mult_job * job = arg;
+    int panels = packed_panels(job);
+    int p1 = (task + 1) * PACK_PANELS;
+
+    pack_panels(job, 0, task * PACK_PANELS, p1 < panels ? p1 : panels);
+}
+
+/**
+* NUMA mode: every worker packs its share of the copy of B it will use, so the pages
+* of each copy are touched first (and therefore allocated) on the node of its users.
+*/
+void pack_each(void * arg, int task, int worker) {
+    (void) task;
+    mult_job * job = arg;
+    int panels = packed_panels(job);
+
+    pack_panels(job, job->copy[worker],
+                (int) ((long) panels * job->rank[worker] / job->size[worker]),
+                (int) ((long) panels * (job->rank[worker] + 1) / job->size[worker]));
+}
+
+/**
+* NUMA mode: every worker copies the rows of A and clears the rows of R of its initial
+* share of the tiles (rows n*w/t to n*(w+1)/t), placing them on its own node.
+*/
+void place_each(void * arg, int task, int worker) {
+    (void) task;
+    mult_job * job = arg;
+    int n = job->a->cols;
+    int t = tpool_size(pool);
+    size_t first = (size_t) n * worker / t;
+    size_t last = (size_t) n * (worker + 1) / t;
+    size_t width = job->small ? (size_t) job->a->width : sizeof(matrix_elem_t);
+    const char * a = job->small ? job->a->small : (void *) job->a->data;
+
+    memcpy((char *) job->a_data + first * n * width, a + first * n * width, (last - first) * n * width);
+    memset(job->r->data + first * n, 0, (last - first) * n * sizeof(matrix_elem_t));
+}
+
+/**
+* Calculate one tile of the result matrix.
 * Matrices A and B are both nxn. 
 *
-* The number of threads passed to the program specifies that
-* each thread calculates the results for n/t rows of matrix A.
-* The last thread will also calculate the remainder rows of Matrix A.
-* 
-* I.e. given two 5x5 matrices and 2 Threads the first thread will calculate rows 0 to 1 and
-* the second thread will calculate rows 2 to 4.
-*/
-void * matrix_mult(void * arg) {
+* R is split into tiles of TILE_ROWS x TILE_COLS elements which are numbered row by row.
+* The tiles are handed out by the thread pool, threads that run out of tiles steal
+* them from the others so no core stays idle at the end.
+*/
+void matrix_mult(void * arg, int task, int worker) {
     
-    thread_info * info = arg;
+    mult_job * job = arg;
+    int n = job->a->cols;
 
-    int x, i, j;
-    matrix_elem_t sum;
+    int i = (task / job->tile_cols) * TILE_ROWS;
+    int j = (task % job->tile_cols) * TILE_COLS;
+
+    int i1 = (i + TILE_ROWS < n) ? i + TILE_ROWS : n;
+    int j1 = (j + TILE_COLS < n) ? j + TILE_COLS : n;
+
+    if (job->small) {
+        gemm16_tile(job->a_data, job->a->width, n, &job->pb16[job->copy[worker]], job->r->data, n,
+                    i, i1, j, j1, job->a_buf[worker]);
+    } else {
+        gemm_tile(job->a_data, n, &job->pb[job->copy[worker]], job->r->data, n,
+                  i, i1, j, j1, job->a_buf[worker]);
+    }
+}
+
+/**
+* Decide which copy of B every worker uses: with replication one copy per NUMA node
+* of the pinned CPUs, otherwise a single one.
+*/
+void assign_copies(mult_job * job, int t) {
+    int w, v;
+    int * node = calloc(t, sizeof(int));
+
+    job->copy = calloc(t, sizeof(int));
+    job->rank = calloc(t, sizeof(int));
+    job->size = calloc(t, sizeof(int));
+    if (node == NULL || job->copy == NULL || job->rank == NULL || job->size == NULL) {
+        perror("Could not allocate memory for thread elements!");
+        exit(EXIT_FAILURE);
+    }
+
+    job->copies = 0;
+    for (w = 0; w < t; ++w) {
+        if (numa.replicate && numa.cpus != NULL) {
+            node[w] = affinity_node_of_cpu(numa.cpus[w % numa.ncpus]);
+        }
 
-    // info->a-cols is used throughout the program because we only calculate nxn matrices so all dimensions are the same.
-    // Using only the same value may result in faster performance since the value will probably always be in the cache.
-    for (i = info->i; i < info->j; ++i) {
-        for (j = 0; j < info->a->cols; ++j) {
-            sum = 0;
-            for (x = 0; x < info->a->cols; ++x) {
-                sum += info->a->data[(i * info->a->cols) + x] * info->b->data[(j * info->a->cols) + x];
+        // Workers on the same node share a copy
+        for (v = 0; v < w && node[v] != node[w]; ++v);
+        job->copy[w] = (v < w) ? job->copy[v] : job->copies++;
+    }
+
+    for (w = 0; w < t; ++w) {
+        for (v = 0; v < t; ++v) {
+            if (job->copy[v] == job->copy[w]) {
+                job->rank[w] += (v < w);
+                job->size[w]++;
             }
-            info->r->data[(i * info->a->cols) + j] = sum;
         }
     }
 
-    return NULL;
+    free(node);
+}
+
+// Rows of R calculated by one task of the sparse multiplication
+#define SPARSE_ROWS 16
+
+typedef struct {
+    matrix_t * a, * b, * r;
+    int64_t * b_rows;   // Dense B, row major, NULL if B is sparse
+} sparse_job;
+
+/**
+* Calculate the rows [task * SPARSE_ROWS, (task + 1) * SPARSE_ROWS) of R for sparse A.
+* The rows differ in their number of elements, stealing evens that out.
+*/
+void matrix_mult_sparse_task(void * arg, int task, int worker) {
+    (void) worker;
+    sparse_job * job = arg;
+    int n = job->r->cols;
+    int i0 = task * SPARSE_ROWS;
+    int i1 = (i0 + SPARSE_ROWS < job->r->rows) ? i0 + SPARSE_ROWS : job->r->rows;
+
+    if (job->b_rows == NULL) {
+        csr_spgemm_rows(job->a->sparse, job->b->sparse, i0, i1, job->r->data, n);
+    } else {
+        csr_spmm_rows(job->a->sparse, job->b_rows, n, n, i0, i1, job->r->data, n);
+    }
+}
+
+/**
+* R = A * B for sparse A (see csr.h). A dense B, which is stored transposed, is
+* copied row major for the multiplication.
+*/
+void matrix_mult_sparse(matrix_t * a, matrix_t * b, matrix_t * r) {
+    sparse_job job = { a, b, r, NULL };
+    size_t n = b->rows, k, j;
+
+    if (b->sparse == NULL) {
+        job.b_rows = malloc(n * b->cols * sizeof(matrix_elem_t));
+        if (job.b_rows == NULL) {
+            perror("Could not allocate memory for matrix!");
+            exit(EXIT_FAILURE);
+        }
+        for (j = 0; j < (size_t) b->cols; ++j) {
+            for (k = 0; k < n; ++k) {
+                job.b_rows[k * b->cols + j] = (matrix_elem_t) element(b, j * n + k);
+            }
+        }
+    }
+
+    tpool_run(pool, (r->rows + SPARSE_ROWS - 1) / SPARSE_ROWS, &matrix_mult_sparse_task, &job);
+    free(job.b_rows);
 }
 
 bool matrix_mult_threaded(matrix_t * a, matrix_t * b, matrix_t * r, int t) {
@@ -125,9 +488,6 @@ bool matrix_mult_threaded(matrix_t * a, matrix_t * b, matrix_t * r, int t) {
     r->rows = a->rows;
     r->cols = a->rows;
 
-    int rows_per_thread = a->rows / t; // Number of rows (of Matrix A) each thread shall calculate
-    int remainder = a->rows % t;    // The last thread will also have to calculate the remainder rows
-
     // Try to allocate memory for the result matrix
     r->data = calloc((r->rows * r->cols), sizeof(matrix_elem_t));
     if (r->data == NULL) {
@@ -135,80 +495,444 @@ bool matrix_mult_threaded(matrix_t * a, matrix_t * b, matrix_t * r, int t) {
         exit(EXIT_FAILURE);
     }
 
-    int i, s;
+    // The threads are only created once, later calls just wake them up
+    if (pool == NULL || tpool_size(pool) != t) {
+        tpool_destroy(pool);
+        pool = tpool_create(t, numa.cpus, numa.ncpus);
+        if (pool == NULL) {
+            perror("Could not create thread pool!");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    // Try to allocate memory for the thread elements
-    thread_info * tinfo = calloc(t, sizeof(thread_info));
-    if (tinfo == NULL) {
-        perror("Could not allocate memory for thread elements!");
-        exit(EXIT_FAILURE);
+    // Sparse A is multiplied row by row, a sparse B alone is expanded for the dense kernels
+    if (a->sparse != NULL) {
+        matrix_mult_sparse(a, b, r);
+        return true;
+    }
+    if (b->sparse != NULL) {
+        densify_matrix(b, true);
     }
 
-    for (i = 0; i < t; ++i) {
-        tinfo[i].a = a;
-        tinfo[i].b = b;
-        tinfo[i].r = r;
-        tinfo[i].i = i*rows_per_thread;     // First row for this thread
-        tinfo[i].j = (i+1)*rows_per_thread; // First row that should *not* be calculate by this thread
+    int i;
+    mult_job job = { a, b, r, a->data, false, NULL, NULL, 0, NULL, NULL, NULL, NULL, 0, 0 };
+    assign_copies(&job, t);
 
-        if (i == (t-1)) {
-            tinfo[i].j = tinfo[i].j + remainder; // Last thread needs to calculate the remaining rows too.
+    // The small integer kernel needs both operands narrowed and pairs of products that fit into int32
+    job.small = a->width != 0 && b->width != 0 && gemm16_fits(a->max_abs, b->max_abs);
+    if (job.small) {
+        job.a_data = a->small;
+    } else {
+        if (a->width != 0) {
+            widen_matrix(a);
+        }
+        if (b->width != 0) {
+            widen_matrix(b);
         }
+        job.a_data = a->data;
+    }
+    size_t a_width = job.small ? (size_t) a->width : sizeof(matrix_elem_t);
 
-        // Try to create a new thread
-        s = pthread_create(&tinfo[i].thread_id, NULL, &matrix_mult, (void *) &tinfo[i]);
-        if (s != 0) {
-            perror("Couldnt create thread!");
+    // Try to allocate memory for the packed copies of B
+    job.pb = calloc(job.copies, sizeof(gemm_packed_b));
+    job.pb16 = calloc(job.copies, sizeof(gemm16_packed_b));
+    if (job.pb == NULL || job.pb16 == NULL) {
+        perror("Could not allocate memory for packed matrix!");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < job.copies; ++i) {
+        if (job.small ? !gemm16_packed_b_alloc(&job.pb16[i], b->rows, b->cols, a->max_abs, b->max_abs)
+                      : !gemm_packed_b_alloc(&job.pb[i], b->rows, b->cols)) {
+            perror("Could not allocate memory for packed matrix!");
             exit(EXIT_FAILURE);
         }
     }
 
-    // Join all threads
+    // Try to allocate memory for the packing buffers
+    job.a_buf = calloc(t, sizeof(void *));
+    if (job.a_buf == NULL) {
+        perror("Could not allocate memory for packing buffers!");
+        exit(EXIT_FAILURE);
+    }
     for (i = 0; i < t; ++i) {
-        pthread_join(tinfo[i].thread_id, NULL);
+        job.a_buf[i] = job.small ? malloc(gemm16_pack_a_size() * sizeof(int16_t))
+                                 : malloc(gemm_pack_a_size() * sizeof(gemm_elem_t));
+        if (job.a_buf[i] == NULL) {
+            perror("Could not allocate memory for packing buffers!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (numa.enabled) {
+        // The copy of A is not touched until the workers fill it
+        job.a_data = malloc((size_t) a->rows * a->cols * a_width);
+        if (job.a_data == NULL) {
+            perror("Could not allocate memory for matrix!");
+            exit(EXIT_FAILURE);
+        }
+        tpool_run_each(pool, &place_each, &job);
+        tpool_run_each(pool, &pack_each, &job);
+    } else {
+        int panels = packed_panels(&job);
+        tpool_run(pool, (panels + PACK_PANELS - 1) / PACK_PANELS, &pack_task, &job);
     }
 
-    free(tinfo);
+    job.tile_rows = (r->rows + TILE_ROWS - 1) / TILE_ROWS;
+    job.tile_cols = (r->cols + TILE_COLS - 1) / TILE_COLS;
+    tpool_run(pool, job.tile_rows * job.tile_cols, &matrix_mult, &job);
+
+    for (i = 0; i < t; ++i) {
+        free(job.a_buf[i]);
+    }
+    free(job.a_buf);
+    for (i = 0; i < job.copies; ++i) {
+        gemm_packed_b_free(&job.pb[i]);
+        gemm16_packed_b_free(&job.pb16[i]);
+    }
+    free(job.pb);
+    free(job.pb16);
+    free(job.copy);
+    free(job.rank);
+    free(job.size);
+    if (numa.enabled) {
+        free(job.a_data);
+    }
     return true;
 }
 
+// Rows of B * x or of A * y - R * x calculated by one task of the check
+#define VERIFY_ROWS 256
+
+typedef struct {
+    matrix_t * a, * b, * r;
+    uint64_t * x, * y;
+    bool * wrong;       // Per task: a row of A * y differs from R * x
+} verify_job;
+
+/**
+* y = B * x for the rows [task * VERIFY_ROWS, (task + 1) * VERIFY_ROWS) of B.
+* B is stored transposed, so the columns selected by x are added up.
+*/
+void verify_bx(void * arg, int task, int worker) {
+    (void) worker;
+    verify_job * job = arg;
+    size_t n = job->b->rows, k, j;
+    size_t k0 = (size_t) task * VERIFY_ROWS;
+    size_t k1 = (k0 + VERIFY_ROWS < n) ? k0 + VERIFY_ROWS : n;
+
+    if (job->b->sparse != NULL) {
+        for (k = k0; k < k1; ++k) {
+            job->y[k] = csr_row_dot(job->b->sparse, k, job->x);
+        }
+        return;
+    }
+
+    memset(&job->y[k0], 0, (k1 - k0) * sizeof(uint64_t));
+    for (j = 0; j < (size_t) job->b->cols; ++j) {
+        if (job->x[j]) {
+            for (k = k0; k < k1; ++k) {
+                job->y[k] += element(job->b, j * n + k);
+            }
+        }
+    }
+}
+
+/**
+* Compare A * y with R * x for the rows [task * VERIFY_ROWS, (task + 1) * VERIFY_ROWS).
+* Both are calculated modulo 2^64, like the multiplication.
+*/
+void verify_rows(void * arg, int task, int worker) {
+    (void) worker;
+    verify_job * job = arg;
+    size_t n = job->a->cols, i, k;
+    size_t i0 = (size_t) task * VERIFY_ROWS;
+    size_t i1 = (i0 + VERIFY_ROWS < (size_t) job->a->rows) ? i0 + VERIFY_ROWS : (size_t) job->a->rows;
+
+    for (i = i0; i < i1; ++i) {
+        uint64_t ay = 0, rx = 0;
+        if (job->a->sparse != NULL) {
+            ay = csr_row_dot(job->a->sparse, i, job->y);
+        }
+        for (k = 0; k < n && job->a->sparse == NULL; ++k) {
+            ay += element(job->a, i * n + k) * job->y[k];
+        }
+        for (k = 0; k < (size_t) job->r->cols; ++k) {
+            rx += job->x[k] ? (uint64_t) job->r->data[i * job->r->cols + k] : 0;
+        }
+        if (ay != rx) {
+            job->wrong[task] = true;
+        }
+    }
+}
+
+/**
+* Check r = a * b with Freivalds' algorithm (see freivalds.h) on the thread pool of
+* matrix_mult_threaded. Returns the number of failed trials.
+*/
+int matrix_verify(matrix_t * a, matrix_t * b, matrix_t * r, int trials) {
+    verify_job job = { a, b, r, NULL, NULL, NULL };
+    int y_tasks = (b->rows + VERIFY_ROWS - 1) / VERIFY_ROWS;
+    int r_tasks = (a->rows + VERIFY_ROWS - 1) / VERIFY_ROWS;
+    uint64_t seed = freivalds_seed();
+    int trial, task, failed = 0;
+    size_t j;
+
+    job.x = malloc(b->cols * sizeof(uint64_t));
+    job.y = malloc(b->rows * sizeof(uint64_t));
+    job.wrong = malloc(r_tasks * sizeof(bool));
+    if (job.x == NULL || job.y == NULL || job.wrong == NULL) {
+        perror("Could not allocate memory for verification!");
+        exit(EXIT_FAILURE);
+    }
+
+    for (trial = 0; trial < trials; ++trial) {
+        for (j = 0; j < (size_t) b->cols; ++j) {
+            job.x[j] = freivalds_x(seed, trial, j);
+        }
+        memset(job.wrong, 0, r_tasks * sizeof(bool));
+        tpool_run(pool, y_tasks, &verify_bx, &job);
+        tpool_run(pool, r_tasks, &verify_rows, &job);
+
+        for (task = 0; task < r_tasks; ++task) {
+            if (job.wrong[task]) {
+                ++failed;
+                break;
+            }
+        }
+    }
+
+    free(job.x);
+    free(job.y);
+    free(job.wrong);
+    return failed;
+}
+
+/**
+* Configure the NUMA mode of matrix_mult_threaded.
+* cpus (ncpus entries) is the affinity map: worker i is pinned to cpus[i % ncpus], NULL
+* leaves the threads unpinned. If place is set, A, R and the packed B are first touched
+* by the workers that use them, so their pages end up on the right node. If replicate
+* is set every NUMA node of the map gets its own packed copy of B.
+*/
+void matrix_mult_numa(int * cpus, int ncpus, bool place, bool replicate) {
+    numa.enabled = place;
+    numa.cpus = cpus;
+    numa.ncpus = ncpus;
+    numa.replicate = replicate;
+
+    // The pool is created again with the new pinning by the next multiplication
+    tpool_destroy(pool);
+    pool = NULL;
+}
+
+/**
+* Stop the threads of the pool used by matrix_mult_threaded.
+*/
+void matrix_mult_cleanup(void) {
+    tpool_destroy(pool);
+    pool = NULL;
+}
+
+/* Time bench->reps multiplications of a and b after bench->warmups untimed ones */
+static void bench_time(bench_options * bench, matrix_t * a, matrix_t * b, int t, double * times) {
+    int i;
+    matrix_t r = {0};
+
+    for (i = -bench->warmups; i < bench->reps; ++i) {
+        double start = bench_now();
+        matrix_mult_threaded(a, b, &r, t);
+        if (i >= 0) {
+            times[i] = bench_now() - start;
+        }
+        free(r.data);
+    }
+}
+
+/* Benchmark mode: time the multiplication of synthetic operands, see bench.h.
+ * The int64 kernel is timed first, then the operands are narrowed and the
+ * gemm16.c kernel is timed as a kernel of its own (pmmul_opt_narrow). */
+void matrix_mult_bench(bench_options * bench, int t) {
+    int n = bench->size;
+    matrix_t a = {0};
+    matrix_t b = a;
+
+    a.rows = a.cols = b.rows = b.cols = n;
+    a.data = malloc((size_t) n * n * sizeof(matrix_elem_t));
+    b.data = malloc((size_t) n * n * sizeof(matrix_elem_t));
+    double * times = malloc(bench->reps * sizeof(double));
+    if (a.data == NULL || b.data == NULL || times == NULL) {
+        perror("Could not allocate memory for benchmark!");
+        exit(EXIT_FAILURE);
+    }
+    bench_fill_int64(a.data, (size_t) n * n, 1000, 1);
+    bench_fill_int64(b.data, (size_t) n * n, 1000, 2);
+
+    bench_time(bench, &a, &b, t, times);
+    bench_report("pmmul_opt", "int64", n, t, times, bench->reps);
+
+    narrow_matrix(&a);
+    narrow_matrix(&b);
+    if (a.width != 0 && b.width != 0 && gemm16_fits(a.max_abs, b.max_abs)) {
+        bench_time(bench, &a, &b, t, times);
+        bench_report("pmmul_opt_narrow", (a.width == 1 && b.width == 1) ? "int8" : "int16", n, t, times, bench->reps);
+    }
+
+    free(times);
+    free_matrix(&a);
+    free_matrix(&b);
+}
+
 int main(int argc, char **argv) {
 
     TIME_GET(timer_1);
 
-    matrix_t a = {0, 0, NULL};
+    matrix_t a = {0};
     matrix_t b = a;
     matrix_t r = a;
 
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <file1> <file2> <threadcount>\n", argv[0]);
+    matwrite_mode mode = MATWRITE_TEXT;
+    char * output = NULL;
+    int opt;
+
+    int * cpus = NULL, ncpus = 0;
+    bool place = false, replicate = false;
+    bench_options bench = BENCH_DEFAULTS;
+    int verify = 0;     // Freivalds trials, 0 without --verify
+
+    static const struct option long_options[] = {
+        { "verify", optional_argument, NULL, 'V' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "o:f:np:rb:w:k:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'V':
+            if ((verify = freivalds_parse(optarg)) < 0) {
+                fprintf(stderr, "Invalid number of trials %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            bench.size = (int) strtol(optarg, NULL, 0);
+            break;
+        case 'w':
+            bench.warmups = (int) strtol(optarg, NULL, 0);
+            break;
+        case 'k':
+            bench.reps = (int) strtol(optarg, NULL, 0);
+            break;
+        case 'n':
+            place = true;
+            break;
+        case 'p':
+            if ((ncpus = affinity_parse(optarg, &cpus)) < 0) {
+                fprintf(stderr, "Invalid CPU list %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r':
+            place = true;
+            replicate = true;
+            break;
+        case 'o':
+            if (!matwrite_parse_mode(optarg, &mode)) {
+                fprintf(stderr, "Unknown output mode %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'f':
+            output = optarg;
+            break;
+        default:
+            argc = 0;   // Print the usage
+        }
+    }
+
+    // In benchmark mode the operands are generated, only the thread count is given
+    bool args_ok = argc - optind == (bench.size > 0 ? 1 : 3);
+    char * end = NULL;
+    long threads = args_ok ? strtol(argv[argc - 1], &end, 0) : 0; // The last argument
+    if (!args_ok || end == argv[argc - 1] || *end != '\0' || threads < 1 || threads > INT_MAX
+        || bench.size < 0 || bench.warmups < 0 || bench.reps < 1) {
+        fprintf(stderr, "Usage: %s [-o text|binary|sum] [-f <output file>] [-n] [-r] [-p <cpus>] [--verify[=<trials>]] <file1> <file2> <threadcount>\n", argv[0]);
+        fprintf(stderr, "       %s -b <size> [-w <warmups>] [-k <reps>] [-n] [-r] [-p <cpus>] <threadcount>\n", argv[0]);
+        fprintf(stderr, "  -n  NUMA mode: place A, R and B on the nodes of the threads using them\n");
+        fprintf(stderr, "  -r  NUMA mode with one copy of B per node\n");
+        fprintf(stderr, "  -p  pin thread i to the i-th CPU of the list, e.g. 0-7,16-23\n");
+        fprintf(stderr, "  --verify  check the result with Freivalds' algorithm (default: %d trials)\n", FREIVALDS_TRIALS);
+        fprintf(stderr, "  -b  benchmark the multiplication of two generated size x size matrices\n");
+        fprintf(stderr, "      (default: 1 warmup, 5 repetitions) and print the timings as CSV\n");
         return EXIT_FAILURE;
     }
+    argv += optind - 1;
+    int t = (int) threads; // Number of threads
+
+    // NUMA mode pins the threads, by default to the CPUs the process may use
+    if (place && cpus == NULL) {
+        ncpus = affinity_default(&cpus);
+    }
+    if (cpus != NULL || place) {
+        matrix_mult_numa(cpus, ncpus, place, replicate);
+    }
 
-    int t = (int) strtol(argv[3], NULL, 0); // Number of threads
+    if (bench.size > 0) {
+        matrix_mult_bench(&bench, t);
+        matrix_mult_cleanup();
+        free(cpus);
+        return EXIT_SUCCESS;
+    }
+
+    // Read B in a second thread while A is read
+    read_info read_b = { 0, argv[2], &b, true, t, false };
+    if (pthread_create(&read_b.thread_id, NULL, &read_matrix_thread, &read_b) != 0) {
+        perror("Couldnt create thread!");
+        return EXIT_FAILURE;
+    }
 
-    if (!read_matrix(argv[1], &a, false)) {
+    bool read_a = read_matrix(argv[1], &a, false, t);
+    pthread_join(read_b.thread_id, NULL);
+
+    if (!read_a) {
         fputs("could not read input matrix A", stderr);
         return EXIT_FAILURE;
     }
 
-    if (!read_matrix(argv[2], &b, true)) {
+    if (!read_b.ok) {
         fputs("could not read input matrix B", stderr);
         return EXIT_FAILURE;
     }
 
+    bool verified = true;
     if (matrix_mult_threaded(&a, &b, &r, t)) {
-        print_matrix(r);
+        if (verify > 0) {
+            verified = freivalds_report(verify, matrix_verify(&a, &b, &r, verify));
+        }
+
+        // Write to stdout unless an output file is given
+        int fd = STDOUT_FILENO;
+        if (output != NULL && (fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+            perror("Could not create file!");
+            return EXIT_FAILURE;
+        }
+        if (!print_matrix(r, mode, fd, t)) {
+            fputs("could not write the result matrix", stderr);
+        }
+        if (fd != STDOUT_FILENO) {
+            close(fd);
+        }
     } else {
         fputs("could not multiply: mismatch between number of rows and columns in in put matricess.", stderr);
     }
 
-    free(a.data);
-    free(b.data);
-    free(r.data);
+    matrix_mult_cleanup();
+    free(cpus);
+
+    free_matrix(&a);
+    free_matrix(&b);
+    free_matrix(&r);
 
     TIME_GET(timer_2);
     fprintf(stderr, "%lf\n", TIME_DIFF(timer_1, timer_2));
 
-    return EXIT_SUCCESS;
+    return verified ? EXIT_SUCCESS : EXIT_FAILURE;
 }
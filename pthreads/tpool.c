@@ -0,0 +1,274 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "affinity.h"
+#include "tpool.h"
+
+/* Deque of task numbers. The owner pops at the bottom, thieves steal at
+ * the top. Both ends are protected by the same lock, which is only
+ * contended when a deque is (almost) empty. */
+typedef struct {
+    pthread_mutex_t lock;
+    int *tasks;
+    int top, bottom;        // Valid tasks are tasks[top..bottom)
+} deque_t;
+
+typedef struct {
+    tpool_t *pool;
+    int index;
+    int cpu;                // CPU to pin to, -1 if not pinned
+    pthread_t thread_id;
+} worker_t;
+
+struct tpool {
+    int nthreads;
+    worker_t *workers;
+    deque_t *deques;
+    int *task_buf;          // Storage of the deques, ntasks elements per job
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;   // Signalled when a new job (or shutdown) is posted
+    pthread_cond_t done;    // Signalled when the last worker finished the job
+    unsigned long job;      // Generation counter of the posted jobs
+    int finished;           // Workers that are done with the current job
+    bool shutdown;
+    bool steal;             // Whether idle workers may steal
+
+    tpool_task_fn fn;
+    void *arg;
+};
+
+static bool pop_bottom(deque_t *d, int *task)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->top < d->bottom) {
+        *task = d->tasks[--d->bottom];
+        found = true;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+static bool steal_top(deque_t *d, int *task)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->top < d->bottom) {
+        *task = d->tasks[d->top++];
+        found = true;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+/* Work on the current job until no deque has tasks left */
+static void work(tpool_t *pool, int me)
+{
+    int task = 0, v;
+
+    for (;;) {
+        while (pop_bottom(&pool->deques[me], &task)) {
+            pool->fn(pool->arg, task, me);
+        }
+
+        if (!pool->steal) {
+            return;
+        }
+
+        // Own deque is empty: look for a victim, starting with the next worker
+        for (v = 1; v < pool->nthreads; ++v) {
+            if (steal_top(&pool->deques[(me + v) % pool->nthreads], &task)) {
+                break;
+            }
+        }
+        if (v == pool->nthreads) {
+            return;         // Tasks are never added during a job, so we are done
+        }
+        pool->fn(pool->arg, task, me);
+    }
+}
+
+static void * worker_main(void * arg)
+{
+    worker_t *w = arg;
+    tpool_t *pool = w->pool;
+    unsigned long seen = 0;
+
+    if (w->cpu >= 0) {
+        affinity_pin(w->cpu);
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->job == seen && !pool->shutdown) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->job;
+        pthread_mutex_unlock(&pool->lock);
+
+        work(pool, w->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->finished == pool->nthreads) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+tpool_t *tpool_create(int nthreads, const int *cpus, int ncpus)
+{
+    int i;
+    tpool_t *pool;
+
+    if (nthreads < 1) {
+        return NULL;
+    }
+
+    pool = calloc(1, sizeof(tpool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->nthreads = nthreads;
+    pool->workers = calloc(nthreads, sizeof(worker_t));
+    pool->deques = calloc(nthreads, sizeof(deque_t));
+    if (pool->workers == NULL || pool->deques == NULL) {
+        free(pool->workers);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (i = 0; i < nthreads; ++i) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    }
+
+    for (i = 0; i < nthreads; ++i) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        pool->workers[i].cpu = (cpus != NULL) ? cpus[i % ncpus] : -1;
+        if (pthread_create(&pool->workers[i].thread_id, NULL, &worker_main, &pool->workers[i]) != 0) {
+            perror("Couldnt create thread!");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return pool;
+}
+
+void tpool_destroy(tpool_t *pool)
+{
+    int i;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nthreads; ++i) {
+        pthread_join(pool->workers[i].thread_id, NULL);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->task_buf);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool);
+}
+
+int tpool_size(const tpool_t *pool)
+{
+    return pool->nthreads;
+}
+
+/* Post a job whose deques are filled and wait until all workers are done */
+static void post(tpool_t *pool, tpool_task_fn fn, void *arg, bool steal)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->steal = steal;
+    pool->finished = 0;
+    pool->job++;
+    pthread_cond_broadcast(&pool->start);
+
+    while (pool->finished < pool->nthreads) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Make room for ntasks task numbers in the deques */
+static void reserve(tpool_t *pool, int ntasks)
+{
+    free(pool->task_buf);
+    pool->task_buf = malloc(ntasks * sizeof(int));
+    if (pool->task_buf == NULL) {
+        perror("Could not allocate memory for tasks!");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void tpool_run(tpool_t *pool, int ntasks, tpool_task_fn fn, void *arg)
+{
+    int i, w, first, last;
+
+    if (ntasks <= 0) {
+        return;
+    }
+
+    // The workers are all parked here, so the deques can be filled without locking
+    reserve(pool, ntasks);
+
+    // Worker w gets the range [first, last). It is stored in descending order,
+    // so the owner (popping at the bottom) walks its range front to back while
+    // thieves take the tasks at its end.
+    for (w = 0; w < pool->nthreads; ++w) {
+        deque_t *d = &pool->deques[w];
+        first = (int) ((long) ntasks * w / pool->nthreads);
+        last = (int) ((long) ntasks * (w + 1) / pool->nthreads);
+
+        d->tasks = pool->task_buf + first;
+        for (i = first; i < last; ++i) {
+            d->tasks[last - 1 - i] = i;
+        }
+        d->top = 0;
+        d->bottom = last - first;
+    }
+
+    post(pool, fn, arg, true);
+}
+
+void tpool_run_each(tpool_t *pool, tpool_task_fn fn, void *arg)
+{
+    int w;
+
+    reserve(pool, pool->nthreads);
+    for (w = 0; w < pool->nthreads; ++w) {
+        deque_t *d = &pool->deques[w];
+        d->tasks = pool->task_buf + w;
+        d->tasks[0] = w;
+        d->top = 0;
+        d->bottom = 1;
+    }
+
+    post(pool, fn, arg, false);
+}
@@ -0,0 +1,33 @@
+#ifndef TPOOL_H
+#define TPOOL_H
+
+/* Persistent pool of worker threads.
+ *
+ * The threads are created once by tpool_create and stay parked on a
+ * condition variable between jobs. A job is a number of independent tasks
+ * 0..ntasks-1. They are distributed in contiguous ranges onto per worker
+ * deques; a worker takes tasks from the bottom of its own deque and, once
+ * that is empty, steals from the top of the other deques. */
+
+typedef struct tpool tpool_t;
+
+/* Called once for every task of a job. worker is the index (0..size-1) of
+ * the thread running it and can be used to select per thread scratch memory. */
+typedef void (*tpool_task_fn)(void *arg, int task, int worker);
+
+/* Create nthreads workers. If cpus is not NULL worker i pins itself to
+ * cpus[i % ncpus] before it takes its first task. */
+tpool_t *tpool_create(int nthreads, const int *cpus, int ncpus);
+void tpool_destroy(tpool_t *pool);
+
+int tpool_size(const tpool_t *pool);
+
+/* Run the tasks 0..ntasks-1 on the pool and return once all are finished */
+void tpool_run(tpool_t *pool, int ntasks, tpool_task_fn fn, void *arg);
+
+/* Run fn exactly once on every worker, with task == worker and without
+ * stealing. Used where the placement of the work matters, e.g. to touch
+ * memory first from the thread that will use it. */
+void tpool_run_each(tpool_t *pool, tpool_task_fn fn, void *arg);
+
+#endif /* TPOOL_H */